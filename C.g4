@@ -1,7 +1,7 @@
 grammar C;
 
 QUALIFIER:
-    'const';
+    'const' | 'restrict';
 
 CHAR:
     '\'' (~['\\\n\r] | '\\' .)+ '\'';
@@ -25,6 +25,9 @@ IDENTIFIER:
 INCLUDESTDIO:
     '#' [ \t]* 'include' [ \t]* ('<stdio.h>' | '"stdio.h"');
 
+NOUNROLL:
+    '#' [ \t]* 'pragma' [ \t]+ 'nounroll';
+
 LINECOMMENT:
     '//' ~[\n\r]* -> skip;
 
@@ -174,7 +177,8 @@ statement:
     scopeStatement |
     ifStatement |
     whileStatement |
-    forStatement;
+    forStatement |
+    NOUNROLL statement;
 
 file:
     (declaration | functionDefinition | ';' | INCLUDESTDIO)* EOF;
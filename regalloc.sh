@@ -0,0 +1,23 @@
+#!/usr/bin/env sh
+# Executed instructions of every program in tests/mips and tests/benchmark with both register allocators, counted by
+# MARS, followed by the totals.
+# usage: ./regalloc.sh [path to the MARS jar]
+mars=$(realpath "${1:-Mars4_5.jar}")
+compiler=$(realpath bin/compiler)
+tests="$(realpath tests/mips) $(realpath tests/benchmark/CorrectCode)"
+dir=$(mktemp -d)
+
+cd "$dir" || exit 1
+echo "file linear graph"
+for folder in $tests; do
+    for file in "$folder"/*.c; do
+        name=$(basename "$file" .c)
+        counts=""
+        for allocator in linear graph; do
+            "$compiler" --regalloc="$allocator" "$file" > /dev/null
+            counts="$counts $(java -jar "$mars" nc ic "$name.asm" < /dev/null | tail -n 1)"
+        done
+        echo "$name$counts"
+    done
+done | awk '{ print; linear += $2; graph += $3 } END { print "total", linear, graph }'
+rm -r "$dir"
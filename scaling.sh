@@ -0,0 +1,27 @@
+#!/usr/bin/env sh
+# Compile time of a generated file with many functions for 1 up to 32 threads, in total and per phase.
+# usage: ./scaling.sh [amount of functions]
+functions=${1:-1000}
+compiler=$(realpath bin/compiler)
+dir=$(mktemp -d)
+
+awk -v n="$functions" 'BEGIN {
+    print "#include <stdio.h>"
+    for (i = 0; i < n; i++) {
+        print "int f" i "(int n)\n{\n    int s = 0;\n    int i;\n    for(i = 0; i < n; i++)\n    {"
+        print "        s = s + i * " i % 7 + 1 " - (i / " i % 5 + 2 ") + (s % " i % 3 + 3 ");\n    }\n    return s;\n}"
+    }
+    print "int main()\n{\n    int x;\n    scanf(\"%d\", &x);"
+    for (i = 0; i < n; i++) print "    x = f" i "(x);"
+    print "    printf(\"%d\\n\", x);\n    return 0;\n}"
+}' > "$dir/scaling.c"
+
+cd "$dir" || exit 1
+echo "jobs parse check convert optimise backend total (milliseconds)"
+for jobs in 1 2 4 8 16 32; do
+    start=$(date +%s%N)
+    phases=$("$compiler" --time -j "$jobs" scaling.c | sed -n 's/.*milliseconds per phase: //p' | tr -d 'a-z,')
+    end=$(date +%s%N)
+    echo "$jobs" $phases "$(( (end - start) / 1000000 ))"
+done
+rm -r "$dir"
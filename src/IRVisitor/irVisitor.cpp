@@ -5,6 +5,7 @@
 #include "irVisitor.h"
 
 #include <ast/expressions.h>
+#include <ast/helper.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/Passes/PassBuilder.h>
@@ -13,12 +14,23 @@
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Utils.h>
+#include <llvm/Transforms/IPO/FunctionAttrs.h>
+#include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Analysis/TypeBasedAliasAnalysis.h>
+#include <llvm/Analysis/ScopedNoAliasAA.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <thread>
 #include "llvmPasses.h"
 
 using namespace llvm;
 
 char RemoveUnusedCodeInBlockPass::ID = 0;
-char RemovePhiInstructionPass::ID = 0;
+char PreparePhiCopiesPass::ID = 0;
+char HoistLoopConstantsPass::ID = 0;
+char SpecializeFunctionsPass::ID = 0;
 
 //static RegisterPass<RemoveUnusedCodeInBlockPass> X("UnusedCode", "remove unused code");
 //static RegisterPass<RemoveUnusedCodeInBlockPass> Y("RemovePhi", "remove phi instructions");
@@ -29,23 +41,170 @@ IRVisitor::IRVisitor(const std::filesystem::path& input)
 	module.setDataLayout("p:32:32");
 }
 
-void IRVisitor::convertAST(const std::unique_ptr<Ast::Node>& root)
+void IRVisitor::convertAST(const std::unique_ptr<Ast::Node>& root, const unsigned jobs)
 {
-	root->visit(*this);
+	const auto& scope = dynamic_cast<Ast::Scope*>(root.get());
+	if (scope) globals = scope->table;
+	if (!scope || jobs<=1) {
+		root->visit(*this);
+		verifyModule(module, &errs());
+		return;
+	}
+
+	// the globals are converted first, the function bodies are then converted on several threads
+	const auto statements = scope->children();
+	std::vector<Ast::FunctionDefinition*> definitions;
+	std::vector<size_t> positions;
+	// the global variables every statement made, the ones of the bodies are only known after the linking
+	std::vector<std::vector<GlobalVariable*>> made(statements.size());
+	for (size_t s = 0; s<statements.size(); s++) {
+		if (const auto& definition = dynamic_cast<Ast::FunctionDefinition*>(statements[s])) {
+			getOrCreateFunction(definition->identifier, globals);
+			definitions.emplace_back(definition);
+			positions.emplace_back(s);
+			continue;
+		}
+		const auto before = module.global_size();
+		statements[s]->visit(*this);
+		for (auto iter = std::next(module.global_begin(), before); iter!=module.global_end(); ++iter) {
+			made[s].emplace_back(&*iter);
+		}
+	}
+
+	std::vector<std::string> order;
+	for (auto& function: module) {
+		order.emplace_back(function.getName().str());
+	}
+
+	// the globals a body makes, like its string literals, are unnamed, so they are named after their body to find
+	// them back once they are linked, a name that starts with a dot can not clash with an identifier
+	const auto tag = [](const size_t definition, const size_t index) {
+		return ".body."+std::to_string(definition)+"."+std::to_string(index);
+	};
+	std::vector<std::vector<std::string>> names(definitions.size());
+
+	// the bodies are divided round-robin, the first share is converted by this visitor straight into this module,
+	// every other thread converts its share in a module of its own that is linked in afterwards
+	const auto count = std::min<size_t>(definitions.size(), jobs);
+	const auto identifier = module.getModuleIdentifier();
+	std::vector<SmallVector<char, 0>> buffers(count);
+	std::vector<std::exception_ptr> errors(count);
+	const auto worker = [&](const size_t i) {
+		try {
+			IRVisitor visitor(identifier);
+			visitor.globals = globals;
+			for (size_t j = i; j<definitions.size(); j += count) {
+				const auto before = visitor.module.global_size();
+				definitions[j]->visit(visitor);
+				for (auto iter = std::next(visitor.module.global_begin(), before);
+				     iter!=visitor.module.global_end(); ++iter) {
+					if (!iter->hasLocalLinkage()) continue;
+					names[j].emplace_back(iter->getName().str());
+					iter->setName(tag(j, names[j].size()-1));
+				}
+			}
+			raw_svector_ostream stream(buffers[i]);
+			WriteBitcodeToFile(visitor.module, stream);
+		}
+		catch (...) {
+			errors[i] = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i<count; i++) {
+		threads.emplace_back(worker, i);
+	}
+	std::exception_ptr error;
+	try {
+		for (size_t j = 0; j<definitions.size(); j += count) {
+			const auto before = module.global_size();
+			definitions[j]->visit(*this);
+			for (auto iter = std::next(module.global_begin(), before); iter!=module.global_end(); ++iter) {
+				made[positions[j]].emplace_back(&*iter);
+			}
+		}
+	}
+	catch (...) {
+		error = std::current_exception();
+	}
+	for (auto& thread: threads) {
+		thread.join();
+	}
+	if (error) std::rethrow_exception(error);
+
+	Linker linker(module);
+	for (size_t i = 1; i<count; i++) {
+		if (errors[i]) std::rethrow_exception(errors[i]);
+		const auto buffer = MemoryBufferRef(StringRef(buffers[i].data(), buffers[i].size()), "part");
+		if (linker.linkInModule(cantFail(parseBitcodeFile(buffer, context)))) {
+			throw InternalError("could not link converted functions into the module");
+		}
+	}
+	// the same order as a sequential conversion, so the output does not depend on the amount of threads
+	for (const auto& name: order) {
+		auto* function = module.getFunction(name);
+		function->removeFromParent();
+		module.getFunctionList().push_back(function);
+	}
+	// the globals as well, the unnamed ones are numbered by their position
+	for (size_t j = 0; j<definitions.size(); j++) {
+		for (size_t k = 0; k<names[j].size(); k++) {
+			auto* global = module.getNamedGlobal(tag(j, k));
+			if (!global) continue;
+			global->setName(names[j][k]);
+			made[positions[j]].emplace_back(global);
+		}
+	}
+	for (const auto& statement: made) {
+		for (auto* global: statement) {
+			global->removeFromParent();
+			module.getGlobalList().push_back(global);
+		}
+	}
 	verifyModule(module, &errs());
 }
 
-void IRVisitor::LLVMOptimize(const int level)
+void IRVisitor::LLVMOptimize(const int level, const int unrollBudget, const unsigned jobs)
 {
 	if (level==1) {
+		// a file with main is a complete program, so only main has to be visible,
+		// without main every definition stays external, like the roots of the call graph
+		const auto* main = module.getFunction("main");
+		if (main && !main->isDeclaration()) {
+			for (auto& function: module) {
+				if (!function.isDeclaration() && &function!=main)
+					function.setLinkage(GlobalValue::InternalLinkage);
+			}
+		}
+
 		createConstantMergePass()->runOnModule(module);
-		legacy::FunctionPassManager m(&module);
+		SpecializeFunctionsPass().runOnModule(module);
+
+		legacy::PassManager m;
+		m.add(createTypeBasedAAWrapperPass());
+		m.add(createScopedNoAliasAAWrapperPass());
 		m.add(createPromoteMemoryToRegisterPass());
 		m.add(createSROAPass());
+		m.add(createIPSCCPPass());
+		m.add(createDeadArgEliminationPass());
+		m.add(createGlobalDCEPass());
+		// infers readnone, readonly and norecurse bottom-up over the call graph
+		m.add(createPostOrderFunctionAttrsLegacyPass());
+		m.add(createReversePostOrderFunctionAttrsPass());
+		if (jobs<=1) addFunctionPasses(m, unrollBudget);
 //		m.add(createCFGSimplificationPass());
 
-		for (auto& function: module.functions()) {
-			m.run(function);
+		m.run(module);
+
+		if (jobs>1) {
+			optimizeFunctions(unrollBudget, jobs);
+		}
+		else {
+			HoistLoopConstantsPass hoist;
+			for (auto& function: module.functions()) {
+				hoist.runOnFunction(function);
+			}
 		}
 	}
 	else if (level>=2) {
@@ -67,12 +226,184 @@ void IRVisitor::LLVMOptimize(const int level)
 				PassBuilder::OptimizationLevel::O3);
 		modulePassManager.run(module, moduleAnalysisManager);
 	}
-	RemovePhiInstructionPass pass;
+	PreparePhiCopiesPass pass;
 	for (auto& F: module) {
 		pass.runOnFunction(F);
 	}
 }
 
+void IRVisitor::addFunctionPasses(legacy::PassManagerBase& m, const int unrollBudget)
+{
+	m.add(createTailCallEliminationPass());
+	m.add(createGVNPass());
+	m.add(createLoopSimplifyPass());
+	m.add(createLCSSAPass());
+	m.add(createLICMPass());
+	if (unrollBudget>0) {
+		// the threshold is the size of the unrolled loop in IR instructions, which map roughly one to one on MIPS
+		m.add(createLoopRotatePass());
+		m.add(createLoopUnrollPass(2, false, false, unrollBudget, -1, 1, 0, 0, 0));
+	}
+}
+
+void IRVisitor::optimizeFunctions(const int unrollBudget, const unsigned jobs)
+{
+	// globals are linked back by name, the unnamed ones only get one until then
+	std::vector<GlobalValue*> unnamed;
+	for (auto& global: module.global_values()) {
+		if (global.hasName()) continue;
+		global.setName("global");
+		unnamed.emplace_back(&global);
+	}
+
+	std::vector<std::string> order;
+	std::vector<Function*> functions;
+	for (auto& function: module) {
+		order.emplace_back(function.getName().str());
+		if (!function.isDeclaration()) functions.emplace_back(&function);
+	}
+	std::vector<std::string> globalOrder;
+	for (auto& global: module.globals()) {
+		globalOrder.emplace_back(global.getName().str());
+	}
+
+	// the functions are divided in a part per thread, the biggest functions first, each in the part with the least work
+	const auto count = std::min<size_t>(functions.size(), jobs);
+	std::vector<std::vector<Function*>> parts(count);
+	std::vector<size_t> work(count);
+
+	auto sorted = functions;
+	std::stable_sort(sorted.begin(), sorted.end(), [](auto* lhs, auto* rhs) {
+		return lhs->getInstructionCount()>rhs->getInstructionCount();
+	});
+	for (auto* function: sorted) {
+		const auto part = std::min_element(work.begin(), work.end())-work.begin();
+		parts[part].emplace_back(function);
+		work[part] += function->getInstructionCount();
+	}
+
+	// the names are read up front, this thread changes the names in its context while the others run
+	std::vector<std::vector<std::string>> names(count);
+	for (size_t i = 0; i<count; i++) {
+		for (auto* function: parts[i]) {
+			names[i].emplace_back(function->getName().str());
+		}
+	}
+
+	// the module is serialised once, every other thread reads it lazily in its own context and only materializes
+	// the bodies of its own part, the first part stays in this module and is optimised in place
+	SmallVector<char, 0> input;
+	raw_svector_ostream inputStream(input);
+	WriteBitcodeToFile(module, inputStream);
+	const auto buffer = MemoryBufferRef(StringRef(input.data(), input.size()), "module");
+
+	std::vector<SmallVector<char, 0>> outputs(count);
+	std::vector<std::exception_ptr> errors(count);
+	const auto worker = [&](const size_t i) {
+		try {
+			LLVMContext workerContext;
+			const auto part = cantFail(getLazyBitcodeModule(buffer, workerContext));
+			for (const auto& name: names[i]) {
+				auto* clone = part->getFunction(name);
+				cantFail(clone->materialize());
+				clone->setLinkage(GlobalValue::ExternalLinkage);
+			}
+			for (auto& function: *part) {
+				if (function.isMaterializable()) function.deleteBody();
+			}
+			cantFail(part->materializeAll());
+
+			legacy::PassManager m;
+			m.add(createTypeBasedAAWrapperPass());
+			m.add(createScopedNoAliasAAWrapperPass());
+			addFunctionPasses(m, unrollBudget);
+			m.run(*part);
+
+			HoistLoopConstantsPass hoist;
+			for (auto& function: part->functions()) {
+				hoist.runOnFunction(function);
+			}
+
+			// the definitions of the globals stay in the original module,
+			// declarations that are not used only slow down serialising and linking
+			for (auto& global: part->globals()) {
+				global.setInitializer(nullptr);
+				global.setLinkage(GlobalValue::ExternalLinkage);
+			}
+			for (auto& global: make_early_inc_range(part->global_values())) {
+				if (global.isDeclaration() && global.use_empty()) global.eraseFromParent();
+			}
+
+			raw_svector_ostream stream(outputs[i]);
+			WriteBitcodeToFile(*part, stream);
+		}
+		catch (...) {
+			errors[i] = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i<count; i++) {
+		threads.emplace_back(worker, i);
+	}
+	if (count) {
+		legacy::FunctionPassManager m(&module);
+		m.add(createTypeBasedAAWrapperPass());
+		m.add(createScopedNoAliasAAWrapperPass());
+		addFunctionPasses(m, unrollBudget);
+		m.doInitialization();
+		HoistLoopConstantsPass hoist;
+		for (auto* function: parts[0]) {
+			m.run(*function);
+			hoist.runOnFunction(*function);
+		}
+		m.doFinalization();
+	}
+	for (auto& thread: threads) {
+		thread.join();
+	}
+
+	// local symbols are made external for a moment, so the declarations in the parts resolve to them
+	std::vector<std::pair<std::string, GlobalValue::LinkageTypes>> locals;
+	for (auto& global: module.global_values()) {
+		if (global.hasLocalLinkage()) {
+			locals.emplace_back(global.getName().str(), global.getLinkage());
+			global.setLinkage(GlobalValue::ExternalLinkage);
+		}
+	}
+
+	Linker linker(module);
+	for (size_t i = 1; i<count; i++) {
+		if (errors[i]) std::rethrow_exception(errors[i]);
+		for (auto* function: parts[i]) {
+			function->deleteBody();
+		}
+		const auto output = MemoryBufferRef(StringRef(outputs[i].data(), outputs[i].size()), "part");
+		if (linker.linkInModule(cantFail(parseBitcodeFile(output, context)))) {
+			throw InternalError("could not link optimised functions back into the module");
+		}
+	}
+
+	for (const auto& [name, linkage]: locals) {
+		module.getNamedValue(name)->setLinkage(linkage);
+	}
+	// the functions and globals are put back in their original order, so the output does not depend on the amount of
+	// threads, linking moves the globals that a part declares
+	for (const auto& name: order) {
+		auto* function = module.getFunction(name);
+		function->removeFromParent();
+		module.getFunctionList().push_back(function);
+	}
+	for (const auto& name: globalOrder) {
+		auto* global = module.getNamedGlobal(name);
+		global->removeFromParent();
+		module.getGlobalList().push_back(global);
+	}
+	for (auto* global: unnamed) {
+		global->setName("");
+	}
+}
+
 void IRVisitor::print(const std::filesystem::path& output)
 {
 	std::error_code ec;
@@ -82,6 +413,15 @@ void IRVisitor::print(const std::filesystem::path& output)
 	module.setDataLayout("p:32:32");
 }
 
+void IRVisitor::printBitcode(const std::filesystem::path& output)
+{
+	std::error_code ec;
+	raw_fd_ostream out(output.string(), ec);
+	module.setDataLayout("");
+	WriteBitcodeToFile(module, out);
+	module.setDataLayout("p:32:32");
+}
+
 void IRVisitor::visitLiteral(const Ast::Literal& literal)
 {
 	auto type = literal.type();
@@ -111,9 +451,8 @@ void IRVisitor::visitComment(const Ast::Comment& comment)
 
 void IRVisitor::visitVariable(const Ast::Variable& variable)
 {
-	const auto tmp = variable.table->lookupAllocaInst(variable.name());
-	if (!tmp) throw InternalError("'"+variable.name()+"' undeclared in LLVM IR");
-	ret = *tmp;
+	ret = lookupValue(variable.table, variable.name());
+	if (!ret) throw InternalError("'"+variable.name()+"' undeclared in LLVM IR");
 	isRvalue = false;
 }
 
@@ -126,42 +465,37 @@ void IRVisitor::visitScope(const Ast::Scope& scope)
 
 void IRVisitor::visitBinaryExpr(const Ast::BinaryExpr& binaryExpr)
 {
-	auto lhs = LRValue(binaryExpr.lhs, true);
-	ret = nullptr;
-
-	const auto targetType = convertToIR(binaryExpr.type());
-	const auto& operationType = binaryExpr.operation.type;
-	bool floatOperation = false;
-	bool pointerOperation = false;
-	const auto lhsType = lhs->getType();
-
 	if (binaryExpr.operation.isLogicalOperator()) {
-		bool lAnd = operationType==BinaryOperation::And;
-		auto lRhs = BasicBlock::Create(context, lAnd ? "land.true" : "lor.false",
-				builder.GetInsertBlock()->getParent());
-		auto lEnd = BasicBlock::Create(context, lAnd ? "land.end" : "lor.end",
-				builder.GetInsertBlock()->getParent());
-		auto current = builder.GetInsertBlock();
-
-		lhs = cast(lhs, builder.getInt1Ty());
-		if (lAnd)
-			builder.CreateCondBr(lhs, lRhs, lEnd);
-		else
-			builder.CreateCondBr(lhs, lEnd, lRhs);
-
-		builder.SetInsertPoint(lRhs);
-		auto rhs = LRValue(binaryExpr.rhs, true);
-		rhs = cast(rhs, builder.getInt1Ty());
+		// the value is only built here, the operands branch directly to the true or false block
+		const auto& function = builder.GetInsertBlock()->getParent();
+		const auto& next = builder.GetInsertBlock()->getNextNode();
+		auto lTrue = BasicBlock::Create(context, "logic.true", function, next);
+		auto lFalse = BasicBlock::Create(context, "logic.false", function, next);
+		auto lEnd = BasicBlock::Create(context, "logic.end", function, next);
+
+		branchLogical(binaryExpr, lTrue, lFalse);
+		builder.SetInsertPoint(lTrue);
+		builder.CreateBr(lEnd);
+		builder.SetInsertPoint(lFalse);
 		builder.CreateBr(lEnd);
 
 		builder.SetInsertPoint(lEnd);
 		auto phi = builder.CreatePHI(builder.getInt1Ty(), 2);
-		phi->addIncoming(lAnd ? builder.getFalse() : builder.getTrue(), current);
-		phi->addIncoming(rhs, lRhs);
+		phi->addIncoming(builder.getTrue(), lTrue);
+		phi->addIncoming(builder.getFalse(), lFalse);
 		ret = phi;
 		return;
 	}
 
+	auto lhs = LRValue(binaryExpr.lhs, true);
+	ret = nullptr;
+
+	const auto targetType = convertToIR(binaryExpr.type());
+	const auto& operationType = binaryExpr.operation.type;
+	bool floatOperation = false;
+	bool pointerOperation = false;
+	const auto lhsType = lhs->getType();
+
 	auto rhs = LRValue(binaryExpr.rhs, true);
 	const auto rhsType = rhs->getType();
 
@@ -250,6 +584,11 @@ void IRVisitor::visitBinaryExpr(const Ast::BinaryExpr& binaryExpr)
 					lhs, rhs, "div");
 		else if (operationType==BinaryOperation::Mod)
 			ret = builder.CreateBinOp(Instruction::SRem, lhs, rhs, "mod");
+
+		// signed int overflow is undefined
+		const auto& binary = dyn_cast<BinaryOperator>(ret);
+		if (targetType->isIntegerTy(32) && binary && isa<OverflowingBinaryOperator>(binary))
+			binary->setHasNoSignedWrap();
 	}
 
 	if (!ret)
@@ -260,11 +599,11 @@ void IRVisitor::visitBinaryExpr(const Ast::BinaryExpr& binaryExpr)
 void IRVisitor::visitPostfixExpr(const Ast::PostfixExpr& postFixExpr)
 {
 	const auto lvalue = LRValue(postFixExpr.operand, false);
-	const auto rvalue = builder.CreateLoad(lvalue);
+	const auto rvalue = createLoad(lvalue);
 
 	const auto& rhs = increaseOrDecrease(
 			postFixExpr.operation.type==PostfixOperation::Incr, rvalue);
-	builder.CreateStore(rhs, lvalue);
+	createStore(rhs, lvalue);
 
 	ret = rvalue;
 }
@@ -279,10 +618,10 @@ void IRVisitor::visitPrefixExpr(const Ast::PrefixExpr& prefixExpr)
 	else if (opType==PrefixOperation::Incr ||
 			opType==PrefixOperation::Decr) {
 		const auto lvalue = LRValue(prefixExpr.operand, false);
-		const auto rvalue = builder.CreateLoad(lvalue);
+		const auto rvalue = createLoad(lvalue);
 
 		ret = increaseOrDecrease(opType==PrefixOperation::Incr, rvalue);
-		builder.CreateStore(ret, lvalue);
+		createStore(ret, lvalue);
 		return;
 	}
 
@@ -295,7 +634,7 @@ void IRVisitor::visitPrefixExpr(const Ast::PrefixExpr& prefixExpr)
 		if (type->isFloatTy())
 			ret = builder.CreateFSub(ConstantFP::get(type, 0), ret, "neg");
 		else
-			ret = builder.CreateSub(ConstantInt::get(type, 0), ret, "neg");
+			ret = builder.CreateSub(ConstantInt::get(type, 0), ret, "neg", false, type->isIntegerTy(32));
 	}
 	else if (opType==PrefixOperation::Not) {
 		ret = cast(ret, builder.getInt1Ty());
@@ -318,7 +657,7 @@ void IRVisitor::visitAssignment(const Ast::Assignment& assignment)
 	auto rhs = LRValue(assignment.rhs, true);
 	auto lhs = LRValue(assignment.lhs, false);
 	rhs = cast(rhs, lhs->getType()->getContainedType(0));
-	builder.CreateStore(rhs, lhs);
+	createStore(rhs, lhs);
 	ret = rhs;
 }
 
@@ -346,14 +685,13 @@ void IRVisitor::visitDeclaration(const Ast::VariableDeclaration& declaration)
 		if (declaration.expr) {
 			ret = LRValue(declaration.expr, true);
 			ret = cast(ret, type);
-			builder.CreateStore(ret, allocaInst);
+			createStore(ret, allocaInst);
 		}
 	}
 }
 
 void IRVisitor::visitIfStatement(const Ast::IfStatement& ifStatement)
 {
-	ret = LRValue(ifStatement.condition, true);
 	const auto& ifTrue = BasicBlock::Create(
 			context, "if.true", builder.GetInsertBlock()->getParent());
 	BasicBlock* ifFalse =
@@ -364,8 +702,7 @@ void IRVisitor::visitIfStatement(const Ast::IfStatement& ifStatement)
 	const auto& ifEnd = BasicBlock::Create(context, "if.end",
 			builder.GetInsertBlock()->getParent());
 
-	ret = cast(ret, builder.getInt1Ty());
-	builder.CreateCondBr(ret, ifTrue, ifFalse ? ifFalse : ifEnd);
+	branchCondition(ifStatement.condition, ifTrue, ifFalse ? ifFalse : ifEnd);
 
 	builder.SetInsertPoint(ifTrue);
 	ifStatement.ifBody->visit(*this);
@@ -382,28 +719,29 @@ void IRVisitor::visitIfStatement(const Ast::IfStatement& ifStatement)
 
 void IRVisitor::visitLoopStatement(const Ast::LoopStatement& loopStatement)
 {
-	const auto& loopCond = BasicBlock::Create(
-			context, "loop.cond", builder.GetInsertBlock()->getParent());
-	const auto& loopBody = BasicBlock::Create(
-			context, "loop.body", builder.GetInsertBlock()->getParent());
-	const auto& loopEnd = BasicBlock::Create(
-			context, "loop.end", builder.GetInsertBlock()->getParent());
-	const auto& loopIter = loopStatement.iteration ? BasicBlock::Create(context, "loop.iter",
-			builder.GetInsertBlock()->getParent()) : nullptr;
+	// loops are rotated: a guard before the loop and the condition at the bottom, so every iteration only takes
+	// the conditional back-edge. The blocks after the body are inserted when they are reached to keep them in order.
+	const auto& function = builder.GetInsertBlock()->getParent();
+	const auto& loopBody = BasicBlock::Create(context, "loop.body", function);
+	const auto& loopIter = loopStatement.iteration ? BasicBlock::Create(context, "loop.iter") : nullptr;
+	const auto& loopCond = BasicBlock::Create(context, "loop.cond");
+	const auto& loopEnd = BasicBlock::Create(context, "loop.end");
 
 	for (const auto& init: loopStatement.init) {
 		init->visit(*this);
 	}
-	builder.CreateBr(loopStatement.doWhile ? loopBody : loopCond);
 
-	builder.SetInsertPoint(loopCond);
-	if (loopStatement.condition) {
-		ret = LRValue(loopStatement.condition, true);
-		ret = cast(ret, builder.getInt1Ty());
-		builder.CreateCondBr(ret, loopBody, loopEnd);
-	}
-	else
+	const auto createCondition = [&]() {
+		if (loopStatement.condition) branchCondition(loopStatement.condition, loopBody, loopEnd);
+		else builder.CreateBr(loopBody);
+	};
+
+	// the first test can be skipped if the loop runs at least once
+	const auto literal = dynamic_cast<Ast::Literal*>(loopStatement.condition);
+	if (loopStatement.doWhile || (literal && Helper::evaluate(literal)))
 		builder.CreateBr(loopBody);
+	else
+		createCondition();
 
 	builder.SetInsertPoint(loopBody);
 	const auto breakBackup = breakBlock;
@@ -416,14 +754,67 @@ void IRVisitor::visitLoopStatement(const Ast::LoopStatement& loopStatement)
 	builder.CreateBr(loopIter ? loopIter : loopCond);
 
 	if (loopIter) {
+		loopIter->insertInto(function);
 		builder.SetInsertPoint(loopIter);
 		loopStatement.iteration->visit(*this);
 		builder.CreateBr(loopCond);
 	}
 
+	loopCond->insertInto(function);
+	builder.SetInsertPoint(loopCond);
+	createCondition();
+
+	if (!loopStatement.unroll) {
+		// loop metadata refers to itself as first operand
+		auto* disable = MDNode::get(context, MDString::get(context, "llvm.loop.unroll.disable"));
+		auto* loop = MDNode::getDistinct(context, {nullptr, disable});
+		loop->replaceOperandWith(0, loop);
+
+		// a short circuited condition can have multiple back-edges, which are all placed after loop.cond
+		for (auto block = loopCond->getIterator(); block!=loopCond->getParent()->end(); ++block) {
+			const auto terminator = block->getTerminator();
+			if (is_contained(successors(&*block), loopBody)) terminator->setMetadata(LLVMContext::MD_loop, loop);
+			if (&*block==builder.GetInsertBlock()) break;
+		}
+	}
+
+	loopEnd->insertInto(function);
 	builder.SetInsertPoint(loopEnd);
 }
 
+void IRVisitor::branchCondition(Ast::Expr* condition, BasicBlock* ifTrue, BasicBlock* ifFalse)
+{
+	if (const auto& binary = dynamic_cast<Ast::BinaryExpr*>(condition); binary
+			&& binary->operation.isLogicalOperator()) {
+		branchLogical(*binary, ifTrue, ifFalse);
+	}
+	else if (const auto& prefix = dynamic_cast<Ast::PrefixExpr*>(condition); prefix
+			&& prefix->operation.type==PrefixOperation::Not) {
+		branchCondition(prefix->operand, ifFalse, ifTrue);
+	}
+	else {
+		ret = LRValue(condition, true);
+		ret = cast(ret, builder.getInt1Ty());
+		builder.CreateCondBr(ret, ifTrue, ifFalse);
+	}
+}
+
+void IRVisitor::branchLogical(const Ast::BinaryExpr& binaryExpr, BasicBlock* ifTrue, BasicBlock* ifFalse)
+{
+	// the rhs is placed right after the lhs, so the lhs can fall through to it
+	bool lAnd = binaryExpr.operation.type==BinaryOperation::And;
+	auto lRhs = BasicBlock::Create(context, lAnd ? "land.true" : "lor.false",
+			builder.GetInsertBlock()->getParent(), builder.GetInsertBlock()->getNextNode());
+
+	if (lAnd)
+		branchCondition(binaryExpr.lhs, lRhs, ifFalse);
+	else
+		branchCondition(binaryExpr.lhs, ifTrue, lRhs);
+
+	builder.SetInsertPoint(lRhs);
+	branchCondition(binaryExpr.rhs, ifTrue, ifFalse);
+}
+
 void IRVisitor::visitControlStatement(
 		const Ast::ControlStatement& controlStatement)
 {
@@ -453,11 +844,14 @@ void IRVisitor::visitFunctionDefinition(
 	const auto& block = BasicBlock::Create(context, "entry", function);
 	builder.SetInsertPoint(block);
 	size_t i = 0;
+	std::vector<AllocaInst*> restrictSlots;
 	for (auto& parameter : function->args()) {
 		const auto& name = functionDefinition.parameters[i++].second;
-		ret = createAlloca(parameter.getType(), name);
+		const auto& slot = createAlloca(parameter.getType(), name);
+		ret = slot;
 		functionDefinition.body->table->lookup(name)->allocaInst = ret;
-		builder.CreateStore(&parameter, ret);
+		createStore(&parameter, ret);
+		if (parameter.hasNoAliasAttr()) restrictSlots.emplace_back(slot);
 	}
 	functionDefinition.body->visit(*this);
 	if (returnType->isVoidTy())
@@ -468,12 +862,12 @@ void IRVisitor::visitFunctionDefinition(
 		                  : UndefValue::get(returnType));
 	RemoveUnusedCodeInBlockPass removeUnusedCode;
 	removeUnusedCode.runOnFunction(*function);
+	addAliasScopes(*function, restrictSlots);
 }
 
 void IRVisitor::visitFunctionCall(const Ast::FunctionCall& functionCall)
 {
-	const auto& function = llvm::cast<Function>(
-			*functionCall.table->lookupAllocaInst(functionCall.value()));
+	const auto& function = llvm::cast<Function>(lookupValue(functionCall.table, functionCall.value()));
 	std::vector<Value*> arguments;
 	for (int i = 0; i<functionCall.arguments.size(); ++i) {
 		const auto& argument = functionCall.arguments[i];
@@ -497,9 +891,7 @@ void IRVisitor::visitIncludeStdioStatement(
 {
 	auto names = {"printf", "scanf"};
 	for (const auto& name : names) {
-		const auto& printf = module.getOrInsertFunction(name,
-				llvm::FunctionType::get(llvm::Type::getInt32PtrTy(context), builder.getInt8PtrTy(), true)).getCallee();
-		includeStdioStatement.table->lookup(name)->allocaInst = printf;
+		getOrCreateFunction(name, includeStdioStatement.table);
 	}
 }
 
@@ -563,9 +955,10 @@ llvm::Value* IRVisitor::increaseOrDecrease(const bool inc, llvm::Value* input)
 	else if (type->isPointerTy())
 		return builder.CreateInBoundsGEP(input, builder.getInt32(inc*2-1),
 				opName);
+	else if (inc)
+		return builder.CreateAdd(input, ConstantInt::get(type, 1), opName, false, type->isIntegerTy(32));
 	else
-		return builder.CreateBinOp(inc ? Instruction::Add : Instruction::Sub, input,
-				ConstantInt::get(type, 1), opName);
+		return builder.CreateSub(input, ConstantInt::get(type, 1), opName, false, type->isIntegerTy(32));
 }
 
 llvm::Type* IRVisitor::convertToIR(::Type* type, const bool function,
@@ -625,7 +1018,7 @@ Value* IRVisitor::LRValue(Ast::Node* ASTValue, const bool requiresRvalue,
 					value, {builder.getInt64(0), inc ? inc : builder.getInt64(0)});
 		}
 		else {
-			value = builder.CreateLoad(value);
+			value = createLoad(value);
 			if (inc)
 				value = builder.CreateInBoundsGEP(value, inc);
 		}
@@ -643,9 +1036,11 @@ Value* IRVisitor::LRValue(Ast::Node* ASTValue, const bool requiresRvalue,
 
 llvm::Function* IRVisitor::getOrCreateFunction(const std::string& identifier, const std::shared_ptr<SymbolTable> table)
 {
+	// functions are looked up by name, the symbol table is shared with the visitors of other modules
+	if (const auto function = module.getFunction(identifier))
+		return function;
+
 	const auto& ASTFunction = table->lookup(identifier);
-	if (ASTFunction->allocaInst)
-		return llvm::cast<Function>(ASTFunction->allocaInst);
 
 	std::vector<llvm::Type*> llvmParameters;
 	const auto& type = ASTFunction->type->getFunctionType();
@@ -654,13 +1049,110 @@ llvm::Function* IRVisitor::getOrCreateFunction(const std::string& identifier, co
 	}
 	const auto& llvmReturnType = convertToIR(type.returnType, true);
 	const auto& functionType =
-			llvm::FunctionType::get(llvmReturnType, llvmParameters, false);
+			llvm::FunctionType::get(llvmReturnType, llvmParameters, type.variadic);
 	const auto function = llvm::cast<Function>(
 			module.getOrInsertFunction(identifier, functionType).getCallee());
-	table->lookup(identifier)->allocaInst = function;
+	function->addFnAttr(Attribute::NoUnwind);
+	for (size_t i = 0; i<type.parameters.size(); ++i) {
+		if (type.parameters[i]->isPointerType() && type.parameters[i]->isRestrict())
+			function->addParamAttr(i, Attribute::NoAlias);
+	}
 	return function;
 }
 
+llvm::Value* IRVisitor::lookupValue(const std::shared_ptr<SymbolTable>& table, const std::string& name)
+{
+	// locals are stored in the symbol table, globals are looked up by name in the module of this visitor
+	const auto& global = globals ? globals->lookup(name) : nullptr;
+	const auto& slot = table->lookupAllocaInst(name);
+	if (slot && (!global || slot!=&global->allocaInst)) return *slot;
+	if (!global) return slot ? *slot : nullptr;
+
+	if (global->type->isFunctionType()) return getOrCreateFunction(name, globals);
+	if (const auto& variable = module.getGlobalVariable(name, true)) return variable;
+	return new GlobalVariable(module, convertToIR(global->type), global->type->isConst(),
+			GlobalValue::LinkageTypes::ExternalLinkage, nullptr, name);
+}
+
+llvm::LoadInst* IRVisitor::createLoad(llvm::Value* pointer)
+{
+	const auto type = pointer->getType()->getPointerElementType();
+	const auto load = builder.CreateLoad(type, pointer);
+	if (const auto& node = tbaa(type)) load->setMetadata(LLVMContext::MD_tbaa, node);
+	return load;
+}
+
+llvm::StoreInst* IRVisitor::createStore(llvm::Value* value, llvm::Value* pointer)
+{
+	const auto store = builder.CreateStore(value, pointer);
+	if (const auto& node = tbaa(value->getType())) store->setMetadata(LLVMContext::MD_tbaa, node);
+	return store;
+}
+
+llvm::MDNode* IRVisitor::tbaa(llvm::Type* type)
+{
+	// char may alias everything, the other scalar types only themselves
+	MDBuilder mdBuilder(context);
+	const auto root = mdBuilder.createTBAARoot("Simple C TBAA");
+	const auto character = mdBuilder.createTBAAScalarTypeNode("omnipotent char", root);
+
+	MDNode* node;
+	if (type->isIntegerTy(8))
+		node = character;
+	else if (type->isIntegerTy(32))
+		node = mdBuilder.createTBAAScalarTypeNode("int", character);
+	else if (type->isFloatTy())
+		node = mdBuilder.createTBAAScalarTypeNode("float", character);
+	else if (type->isPointerTy())
+		node = mdBuilder.createTBAAScalarTypeNode("any pointer", character);
+	else
+		return nullptr;
+	return mdBuilder.createTBAAStructTagNode(node, node, 0);
+}
+
+void IRVisitor::addAliasScopes(llvm::Function& function, std::vector<llvm::AllocaInst*> slots)
+{
+	// the slot of a restrict parameter only holds the parameter if it is never assigned to
+	const auto assigned = [](AllocaInst* slot) {
+		return count_if(slot->users(), [](const User* user) { return isa<StoreInst>(user); })>1;
+	};
+	slots.erase(std::remove_if(slots.begin(), slots.end(), assigned), slots.end());
+	if (slots.empty()) return;
+
+	MDBuilder mdBuilder(context);
+	const auto domain = mdBuilder.createAnonymousAliasScopeDomain(function.getName());
+	std::vector<MDNode*> scopes;
+	for (const auto& slot: slots) {
+		scopes.emplace_back(mdBuilder.createAnonymousAliasScope(domain, slot->getName()));
+	}
+
+	for (auto& block: function) {
+		for (auto& instruction: block) {
+			Value* pointer;
+			if (const auto& load = dyn_cast<LoadInst>(&instruction)) pointer = load->getPointerOperand();
+			else if (const auto& store = dyn_cast<StoreInst>(&instruction)) pointer = store->getPointerOperand();
+			else continue;
+
+			// find the object the access is based on: a restrict parameter, a local variable or a global
+			while (isa<GEPOperator>(pointer) || isa<BitCastOperator>(pointer)) {
+				pointer = llvm::cast<Operator>(pointer)->getOperand(0);
+			}
+			const auto& load = dyn_cast<LoadInst>(pointer);
+			const auto based = load ? find(slots, load->getPointerOperand()) : slots.end();
+			if (based==slots.end() && !isa<AllocaInst>(pointer) && !isa<GlobalVariable>(pointer)) continue;
+
+			std::vector<Metadata*> others;
+			for (size_t i = 0; i<slots.size(); ++i) {
+				if (based==slots.end() || i!=static_cast<size_t>(based-slots.begin())) others.emplace_back(scopes[i]);
+			}
+			if (based!=slots.end())
+				instruction.setMetadata(LLVMContext::MD_alias_scope,
+						MDNode::get(context, scopes[based-slots.begin()]));
+			if (!others.empty()) instruction.setMetadata(LLVMContext::MD_noalias, MDNode::get(context, others));
+		}
+	}
+}
+
 llvm::Module& IRVisitor::getModule()
 {
 	return module;
@@ -11,6 +11,7 @@
 #include <ast/statements.h>
 #include <llvm/IR/NoFolder.h>
 #include <llvm/Pass.h>
+#include <llvm/IR/LegacyPassManager.h>
 
 #include "ast/expressions.h"
 #include "ast/node.h"
@@ -19,12 +20,14 @@ class IRVisitor {
 public:
 	explicit IRVisitor(const std::filesystem::path& input);
 
-	void convertAST(const std::unique_ptr<Ast::Node>& root);
+	void convertAST(const std::unique_ptr<Ast::Node>& root, unsigned jobs = 1);
 
-	void LLVMOptimize(int level);
+	void LLVMOptimize(int level, int unrollBudget = 0, unsigned jobs = 1);
 
 	void print(const std::filesystem::path& output);
 
+	void printBitcode(const std::filesystem::path& output);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 	void visitLiteral(const Ast::Literal& literal);
@@ -74,6 +77,8 @@ private:
 	llvm::Module module;
 	llvm::IRBuilder<> builder;
 
+	std::shared_ptr<SymbolTable> globals;
+
 	llvm::Value* ret{};
 	llvm::BasicBlock* breakBlock{};
 	llvm::BasicBlock* continueBlock{};
@@ -89,7 +94,25 @@ private:
 
 	llvm::Value* LRValue(Ast::Node* ASTValue, bool requiresRvalue, llvm::Value* inc = nullptr);
 
+	llvm::LoadInst* createLoad(llvm::Value* pointer);
+
+	llvm::StoreInst* createStore(llvm::Value* value, llvm::Value* pointer);
+
+	llvm::MDNode* tbaa(llvm::Type* type);
+
+	void addAliasScopes(llvm::Function& function, std::vector<llvm::AllocaInst*> slots);
+
+	void branchCondition(Ast::Expr* condition, llvm::BasicBlock* ifTrue, llvm::BasicBlock* ifFalse);
+
+	void branchLogical(const Ast::BinaryExpr& binaryExpr, llvm::BasicBlock* ifTrue, llvm::BasicBlock* ifFalse);
+
 	llvm::Function* getOrCreateFunction(const std::string& identifier, std::shared_ptr<SymbolTable> table);
+
+	llvm::Value* lookupValue(const std::shared_ptr<SymbolTable>& table, const std::string& name);
+
+	static void addFunctionPasses(llvm::legacy::PassManagerBase& m, int unrollBudget);
+
+	void optimizeFunctions(int unrollBudget, unsigned jobs);
 };
 
 #endif //COMPILER_IRVISITOR_H
@@ -6,6 +6,12 @@
 #define COMPILER_LLVMPASSES_H
 
 #include <llvm/IR/PassManager.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <map>
 
 using namespace llvm;
 
@@ -32,71 +38,213 @@ public:
 	}
 };
 
-/// based on LLVM lib/Transforms/Utils/DemoteRegToStack.cpp and lib/Transforms/Scalar/Reg2mem.cpp
+/// the MIPS backend copies the incoming values of the phi nodes at the end of their predecessors, so the critical
+/// edges are split and a phi that reads another phi of its block reads a copy made before the other one is overwritten.
+/// The back edge of a loop is kept when the copies are dead in the exit, so the latch ends in a single branch
 
-AllocaInst* DemotePHIToStack(PHINode* P, Instruction* AllocaPoint)
-{
-	if (P->use_empty()) {
-		P->eraseFromParent();
-		return nullptr;
-	}
-	const DataLayout& DL = P->getModule()->getDataLayout();
-	AllocaInst* Slot;
-	if (AllocaPoint) {
-		Slot = new AllocaInst(P->getType(), DL.getAllocaAddrSpace(), nullptr,
-				P->getName()+".reg2mem", AllocaPoint);
-	}
-	else {
-		Function* F = P->getParent()->getParent();
-		Slot = new AllocaInst(P->getType(), DL.getAllocaAddrSpace(), nullptr,
-				P->getName()+".reg2mem",
-				&F->getEntryBlock().front());
+class PreparePhiCopiesPass : public llvm::FunctionPass {
+public:
+	static char ID;
+
+	PreparePhiCopiesPass()
+			:FunctionPass(ID) { }
+
+	bool runOnFunction(llvm::Function& F) final
+	{
+		if (F.isDeclaration()) return false;
+		DominatorTree dominatorTree(F);
+		LoopInfo loopInfo(dominatorTree);
+
+		std::vector<std::pair<Instruction*, unsigned>> edges;
+		for (BasicBlock& block: F) {
+			auto* terminator = block.getTerminator();
+			for (unsigned i = 0; i<terminator->getNumSuccessors(); ++i) {
+				if (isCriticalEdge(terminator, i) && !isKeptBackEdge(loopInfo, block, i)) edges.emplace_back(terminator, i);
+			}
+		}
+		bool changed = false;
+		for (const auto& [terminator, i]: edges) {
+			changed |= SplitCriticalEdge(terminator, i)!=nullptr;
+		}
+		for (BasicBlock& block: F) {
+			for (PHINode& phi: block.phis()) {
+				for (unsigned i = 0; i<phi.getNumIncomingValues(); ++i) {
+					auto* incoming = dyn_cast<PHINode>(phi.getIncomingValue(i));
+					if (!incoming || incoming==&phi || incoming->getParent()!=&block) continue;
+					phi.setIncomingValue(i, new BitCastInst(incoming, incoming->getType(), "",
+							phi.getIncomingBlock(i)->getTerminator()));
+					changed = true;
+				}
+			}
+		}
+		return changed;
 	}
-	for (unsigned i = 0, e = P->getNumIncomingValues(); i<e; ++i) {
-		if (InvokeInst* II = dyn_cast<InvokeInst>(P->getIncomingValue(i))) {
-			assert(II->getParent()!=P->getIncomingBlock(i) &&
-					"Invoke edge not supported yet");
-			(void) II;
+
+private:
+	// the copies into the phis of the header also run when the latch leaves the loop, which is fine when
+	// the phis are only used in the loop and the exit has no phis of its own
+	static bool isKeptBackEdge(const LoopInfo& loopInfo, const BasicBlock& latch, unsigned index)
+	{
+		const auto* terminator = dyn_cast<BranchInst>(latch.getTerminator());
+		if (!terminator || !terminator->isConditional()) return false;
+		const auto* header = terminator->getSuccessor(index);
+		const auto* loop = loopInfo.getLoopFor(header);
+		if (!loop || loop->getHeader()!=header || !loop->contains(&latch)) return false;
+
+		// the branch comes after the copies, so it can not test a phi they overwrite
+		const auto* condition = dyn_cast<PHINode>(terminator->getCondition());
+		if (condition && condition->getParent()==header) return false;
+
+		const auto* exit = terminator->getSuccessor(1-index);
+		if (loop->contains(exit) || !exit->phis().empty()) return false;
+		for (const PHINode& phi: header->phis()) {
+			for (const User* user: phi.users()) {
+				if (!loop->contains(cast<Instruction>(user))) return false;
+			}
 		}
-		new StoreInst(P->getIncomingValue(i), Slot,
-				P->getIncomingBlock(i)->getTerminator());
+		return true;
 	}
-	BasicBlock::iterator InsertPt = P->getIterator();
-	for (; isa<PHINode>(InsertPt) || InsertPt->isEHPad(); ++InsertPt);
-	Value* V =
-			new LoadInst(P->getType(), Slot, P->getName()+".reload", &*InsertPt);
-	P->replaceAllUsesWith(V);
-	P->eraseFromParent();
-	return Slot;
-}
-
-class RemovePhiInstructionPass : public llvm::FunctionPass {
+};
+
+/// constants that take more than one MIPS instruction to materialise (global addresses, floats and large integers)
+/// are moved into a register in the preheader of the outermost loop that uses them
+
+class HoistLoopConstantsPass : public llvm::FunctionPass {
 public:
 	static char ID;
 
-	RemovePhiInstructionPass()
+	HoistLoopConstantsPass()
 			:FunctionPass(ID) { }
 
 	bool runOnFunction(llvm::Function& F) final
 	{
-		if (F.isDeclaration() || skipFunction(F))
-			return false;
-		BasicBlock* BBEntry = &F.getEntryBlock();
-		BasicBlock::iterator I = BBEntry->begin();
-		while (isa<AllocaInst>(I)) ++I;
-		CastInst* AllocaInsertionPoint = new BitCastInst(
-				Constant::getNullValue(llvm::Type::getInt32Ty(F.getContext())),
-				llvm::Type::getInt32Ty(F.getContext()), "reg2mem alloca point", &*I);
-
-		std::list<Instruction*> WorkList;
-		for (BasicBlock& ibb : F)
-			for (BasicBlock::iterator iib = ibb.begin(), iie = ibb.end(); iib!=iie;
-			     ++iib)
-				if (isa<PHINode>(iib))
-					WorkList.push_front(&*iib);
-		for (Instruction* ilb : WorkList)
-			DemotePHIToStack(cast<PHINode>(ilb), AllocaInsertionPoint);
-		return true;
+		if (F.isDeclaration()) return false;
+		DominatorTree dominatorTree(F);
+		LoopInfo loopInfo(dominatorTree);
+
+		bool changed = false;
+		for (Loop* loop: loopInfo) {
+			BasicBlock* preheader = loop->getLoopPreheader();
+			if (!preheader) continue;
+
+			std::map<Constant*, Instruction*> hoisted;
+			for (BasicBlock* block: loop->blocks()) {
+				for (Instruction& instruction: *block) {
+					for (unsigned i = 0; i<instruction.getNumOperands(); ++i) {
+						auto* constant = dyn_cast<Constant>(instruction.getOperand(i));
+						if (!constant || !isHoistable(instruction, i, constant)) continue;
+
+						auto& value = hoisted[constant];
+						if (!value) value = new BitCastInst(constant, constant->getType(), "", preheader->getTerminator());
+						instruction.setOperand(i, value);
+						changed = true;
+					}
+				}
+			}
+		}
+		return changed;
+	}
+
+private:
+	static bool isHoistable(const Instruction& instruction, unsigned index, const Constant* constant)
+	{
+		// these need their operands to stay constant
+		if (isa<PHINode>(instruction) || (isa<GetElementPtrInst>(instruction) && index>0)) return false;
+		if (const auto* call = dyn_cast<CallInst>(&instruction); call && call->getCalledOperand()==constant) return false;
+
+		if (isa<GlobalVariable>(constant) || isa<ConstantFP>(constant)) return true;
+		if (const auto* integer = dyn_cast<ConstantInt>(constant)) {
+			// the backend strength reduces these with the constant as operand, a multiplication on either side
+			if (isa<BinaryOperator>(instruction) && (index==1 || instruction.getOpcode()==Instruction::Mul)) {
+				switch (instruction.getOpcode()) {
+				case Instruction::Mul:
+				case Instruction::SDiv:
+				case Instruction::UDiv:
+				case Instruction::SRem:
+				case Instruction::URem:
+					return false;
+				default:
+					break;
+				}
+			}
+			return !isInt<16>(integer->getSExtValue());
+		}
+		return false;
+	}
+};
+
+/// clones functions for call sites with constant arguments, the constant arguments are removed from the clone
+/// and propagated into its body. The total amount of cloned instructions is bounded by the budget.
+
+class SpecializeFunctionsPass : public llvm::ModulePass {
+public:
+	static char ID;
+
+	explicit SpecializeFunctionsPass(size_t budget = 500, size_t maxClones = 4)
+			:ModulePass(ID), budget(budget), maxClones(maxClones) { }
+
+	bool runOnModule(llvm::Module& module) final
+	{
+		std::vector<CallInst*> calls;
+		for (auto& function: module)
+			for (auto& block: function)
+				for (auto& instruction: block)
+					if (auto* call = dyn_cast<CallInst>(&instruction); call && isCandidate(call->getCalledFunction()))
+						calls.emplace_back(call);
+
+		std::map<std::pair<Function*, std::vector<Constant*>>, Function*> clones;
+		std::map<Function*, size_t> cloneCount;
+		bool changed = false;
+		for (auto* call: calls) {
+			auto* function = call->getCalledFunction();
+
+			std::vector<Constant*> constants;
+			bool hasConstant = false;
+			for (auto& argument: call->args()) {
+				auto* constant = dyn_cast<Constant>(argument);
+				if (constant && (isa<ConstantInt>(constant) || isa<ConstantFP>(constant))) {
+					constants.emplace_back(constant);
+					hasConstant = true;
+				}
+				else constants.emplace_back(nullptr);
+			}
+			if (!hasConstant) continue;
+
+			auto& clone = clones[{function, constants}];
+			if (!clone) {
+				const auto size = function->getInstructionCount();
+				if (size>budget || cloneCount[function]>=maxClones) continue;
+				budget -= size;
+
+				ValueToValueMapTy map;
+				for (auto& argument: function->args()) {
+					if (auto* constant = constants[argument.getArgNo()]) map[&argument] = constant;
+				}
+				clone = CloneFunction(function, map);
+				clone->setName(function->getName()+"_spec"+std::to_string(cloneCount[function]++));
+			}
+
+			std::vector<Value*> arguments;
+			for (auto& argument: call->args()) {
+				if (!constants[argument.getOperandNo()]) arguments.emplace_back(argument);
+			}
+			auto* replacement = CallInst::Create(clone, arguments, "", call);
+			replacement->setCallingConv(call->getCallingConv());
+			replacement->takeName(call);
+			call->replaceAllUsesWith(replacement);
+			call->eraseFromParent();
+			changed = true;
+		}
+		return changed;
+	}
+
+private:
+	size_t budget;
+	size_t maxClones;
+
+	static bool isCandidate(const Function* function)
+	{
+		return function && !function->isDeclaration() && !function->isVarArg() && function->hasLocalLinkage();
 	}
 };
 
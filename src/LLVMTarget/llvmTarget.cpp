@@ -0,0 +1,237 @@
+#include "llvmTarget.h"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+#include "MIPSVisitor/mips.h"
+#include "errors.h"
+
+using namespace llvm;
+
+LLVMTarget::LLVMTarget(llvm::Module& module)
+		:module(module)
+{
+}
+
+void LLVMTarget::convertIR()
+{
+	printf = lowerStdio("printf", 16);
+	scanf = lowerStdio("scanf", 20);
+
+	static const auto initialized = [] {
+		LLVMInitializeMipsTargetInfo();
+		LLVMInitializeMipsTarget();
+		LLVMInitializeMipsTargetMC();
+		LLVMInitializeMipsAsmPrinter();
+
+		// SPIM and MARS do not simulate delay slots by default, so they are only filled with nops
+		auto& options = cl::getRegisteredOptions();
+		if (const auto& option = options.find("disable-mips-delay-filler"); option!=options.end())
+			static_cast<cl::opt<bool>*>(option->second)->setValue(true);
+		return true;
+	}();
+	(void) initialized;
+
+	const std::string triple = "mipsel-unknown-linux-gnu";
+	std::string error;
+	const auto& target = TargetRegistry::lookupTarget(triple, error);
+	if (!target) throw InternalError("the LLVM MIPS target is not available: "+error);
+
+	// static code without abicalls, so globals are addressed with %hi and %lo instead of a global offset table
+	const std::unique_ptr<TargetMachine> machine(
+			target->createTargetMachine(triple, "mips32", "+noabicalls", TargetOptions(), Reloc::Static));
+	module.setTargetTriple(triple);
+	module.setDataLayout(machine->createDataLayout());
+
+	SmallVector<char, 0> buffer;
+	raw_svector_ostream stream(buffer);
+	legacy::PassManager m;
+	if (machine->addPassesToEmitFile(m, stream, nullptr, CGFT_AssemblyFile))
+		throw InternalError("the LLVM MIPS target cannot emit assembly");
+	m.run(module);
+
+	assembly = rewrite(std::string(buffer.data(), buffer.size()));
+}
+
+void LLVMTarget::print(const std::filesystem::path& output)
+{
+	std::ofstream stream(output);
+
+	// main is called first and its return value is the exit code, like in the MIPSVisitor
+	stream << "\t.text\n"
+	          "\taddiu $sp, $sp, -16\n"
+	          "\tjal main\n"
+	          "\tmove $4, $2\n"
+	          "\tli $2, 17\n"
+	          "\tsyscall\n";
+	stream << assembly;
+
+	// the adapters move the stack pointer above the arguments, which the caller stored in a block of its frame
+	const auto adapter = [&](const std::string& name, unsigned frame) {
+		stream << "__" << name << ":\n"
+		       << "\taddiu $sp, $sp, -8\n"
+		          "\tsw $ra, 4($sp)\n"
+		          "\tsw $16, 0($sp)\n"
+		          "\tmove $16, $sp\n"
+		          "\taddiu $sp, $4, " << frame << "\n"
+		       << "\tjal " << name << "\n"
+		       << "\tmove $sp, $16\n"
+		          "\tlw $16, 0($sp)\n"
+		          "\tlw $ra, 4($sp)\n"
+		          "\taddiu $sp, $sp, 8\n"
+		          "\tjr $ra\n";
+	};
+	if (printf || scanf) {
+		stream << "\t.text\n";
+		if (printf) adapter("printf", 16);
+		if (scanf) adapter("scanf", 20);
+		stream << mips::Module::getStdioImpl(printf, scanf);
+	}
+	stream.close();
+}
+
+bool LLVMTarget::lowerStdio(const std::string& name, const unsigned frame)
+{
+	auto* function = module.getFunction(name);
+	if (!function || function->use_empty()) return false;
+
+	auto* word = llvm::Type::getInt32Ty(module.getContext());
+	auto* adapter = Function::Create(llvm::FunctionType::get(word, {PointerType::getUnqual(word)}, false),
+			GlobalValue::ExternalLinkage, "__"+name, module);
+
+	// the routines of stdio.asm take every argument as a word below their frame, the first one highest,
+	// floats are passed as floats and not as doubles
+	for (auto* user: make_early_inc_range(function->users())) {
+		auto* call = llvm::cast<CallInst>(user);
+		const auto count = call->arg_size();
+
+		auto& entry = call->getFunction()->getEntryBlock();
+		IRBuilder<> allocaBuilder(&entry, entry.begin());
+		auto* block = allocaBuilder.CreateAlloca(llvm::ArrayType::get(word, count+frame/4));
+
+		IRBuilder<> builder(call);
+		for (unsigned i = 0; i<count; ++i) {
+			auto* argument = call->getArgOperand(i);
+			if (const auto& extension = dyn_cast<FPExtInst>(argument)) argument = extension->getOperand(0);
+			if (argument->getType()->isDoubleTy()) argument = builder.CreateFPTrunc(argument, builder.getFloatTy());
+
+			if (argument->getType()->isFloatTy()) argument = builder.CreateBitCast(argument, word);
+			else if (argument->getType()->isPointerTy()) argument = builder.CreatePtrToInt(argument, word);
+			else argument = builder.CreateSExtOrTrunc(argument, word);
+			builder.CreateStore(argument,
+					builder.CreateConstInBoundsGEP2_32(block->getAllocatedType(), block, 0, count-1-i));
+		}
+		const auto& end = builder.CreateConstInBoundsGEP2_32(block->getAllocatedType(), block, 0, count);
+		call->replaceAllUsesWith(builder.CreateCall(adapter, {end}));
+		call->eraseFromParent();
+	}
+	function->eraseFromParent();
+	return true;
+}
+
+std::string LLVMTarget::rewrite(const std::string& input)
+{
+	static const std::set<std::string> registers = {
+			"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3", "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7", "t8", "t9",
+			"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "k0", "k1", "gp", "sp", "fp", "ra"};
+	static const std::regex directive(R"(\s*(\.[\w.]+)\s*(.*))");
+	static const std::regex high(R"(\s*lui\s+(\$\w+),\s*%hi\(([^)+\-]+)([+\-]\d+)?\))");
+	static const std::regex low(R"(%lo\(([^)+\-]+)([+\-]\d+)?\)(\((\$\w+)\))?)");
+	static const std::regex source(R"((\$\w+),\s*$)");
+	static const std::regex divide(R"((\s*divu?\s+)\$zero,\s*)");
+	static const std::regex trap(R"((\s*teq\s+\$\w+,\s*\$\w+),\s*\d+)");
+	static const std::regex compare(R"(\bc\.[ou](lt|le|eq)\.)");
+	static const std::regex condition(R"(\$fcc(\d))");
+	static const std::regex symbol(R"(\$([A-Za-z_.][\w.]*))");
+	static const std::regex floating(R"(f\d+)");
+
+	// the local labels of LLVM start with a $, which SPIM and MARS would read as a register
+	const auto rename = [&](const std::string& line) {
+		std::string result;
+		auto begin = line.cbegin();
+		for (std::sregex_iterator iter(line.begin(), line.end(), symbol), end; iter!=end; ++iter) {
+			const auto& name = (*iter)[1].str();
+			result.append(begin, (*iter)[0].first);
+			result += registers.count(name) || std::regex_match(name, floating) ? "$"+name : "L."+name;
+			begin = (*iter)[0].second;
+		}
+		result.append(begin, line.cend());
+		return result+"\n";
+	};
+
+	std::stringstream in(input);
+	std::string output;
+	std::map<std::string, long> offsets;
+
+	for (std::string line; std::getline(in, line);) {
+		// comments only get in the way of the rewrites
+		if (line.find('"')==std::string::npos) line = line.substr(0, line.find('#'));
+		if (line.find_first_not_of(" \t")==std::string::npos) continue;
+
+		std::smatch match;
+		if (std::regex_match(line, match, directive)) {
+			const auto& name = match[1].str();
+			const auto& operands = match[2].str();
+			if (name==".text" || name==".data") output += "\t"+name+"\n";
+			else if (name==".bss" || name==".rdata") output += "\t.data\n";
+			else if (name==".section") {
+				if (operands.rfind(".text", 0)==0) output += "\t.text\n";
+				else if (std::regex_search(operands, std::regex(R"(^\.(s?data|rodata|rdata|s?bss))")))
+					output += "\t.data\n";
+			}
+			else if (name==".p2align") output += "\t.align "+operands+"\n";
+			else if (name==".4byte") output += rename("\t.word "+operands);
+			else if (name==".2byte") output += "\t.half "+operands+"\n";
+			else if (name==".asciz") output += "\t.asciiz "+operands+"\n";
+			else if (name==".ascii") output += "\t.ascii "+operands+"\n";
+			else if (name==".zero") output += "\t.space "+operands+"\n";
+			else if (name==".8byte") {
+				const auto value = std::stoull(operands, nullptr, 0);
+				output += "\t.word "+std::to_string(value & 0xffffffffu)+", "+std::to_string(value >> 32u)+"\n";
+			}
+			else if (name==".byte" || name==".space" || name==".globl" || name==".align" ||
+			         name==".word" || name==".half")
+				output += rename(line);
+			continue;
+		}
+
+		// SPIM and MARS do not know %hi and %lo, so the address is loaded whole with la,
+		// which may go through $at, LLVM reserves $at so it never holds a value of its own.
+		// The %lo that belongs to it only adds the difference in offset, it is found by its base register.
+		if (std::regex_match(line, match, high)) {
+			offsets[match[1].str()+match[2].str()] = match[3].matched ? std::stol(match[3].str()) : 0;
+			line = "\tla "+match[1].str()+", "+match[2].str()+match[3].str();
+		}
+		std::string result;
+		auto begin = line.cbegin();
+		for (std::sregex_iterator iter(line.begin(), line.end(), low), end; iter!=end; ++iter) {
+			const auto& lo = *iter;
+			const auto offset = lo[2].matched ? std::stol(lo[2].str()) : 0;
+			// the base of a load or store follows the %lo, the source of an addiu comes before it
+			std::smatch base;
+			const auto prefix = std::string(line.cbegin(), lo[0].first);
+			const auto reg = lo[4].matched ? lo[4].str() : std::regex_search(prefix, base, source) ? base[1].str() : "";
+			result.append(begin, lo[0].first);
+			result += std::to_string(offset-offsets[reg+lo[1].str()])+lo[3].str();
+			begin = lo[0].second;
+		}
+		result.append(begin, line.cend());
+		line = result;
+
+		line = std::regex_replace(line, divide, "$1");
+		line = std::regex_replace(line, trap, "$1");
+		line = std::regex_replace(line, compare, "c.$1.");
+		line = std::regex_replace(line, condition, "$1");
+		output += rename(line);
+	}
+	return output;
+}
@@ -0,0 +1,30 @@
+#ifndef COMPILER_LLVMTARGET_H
+#define COMPILER_LLVMTARGET_H
+
+#include <llvm/IR/Module.h>
+#include <filesystem>
+
+// Generates the assembly with LLVM's own MIPS code generator (mipsel, o32) instead of the MIPSVisitor,
+// the output is rewritten so it runs in SPIM and MARS with the routines of asm/stdio.asm.
+class LLVMTarget {
+public:
+	// the calls to printf and scanf in the module are rewritten, so the module is not usable afterwards
+	explicit LLVMTarget(llvm::Module& module);
+
+	void convertIR();
+
+	void print(const std::filesystem::path& output);
+
+private:
+	llvm::Module& module;
+	std::string assembly;
+
+	bool printf = false;
+	bool scanf = false;
+
+	bool lowerStdio(const std::string& name, unsigned frame);
+
+	static std::string rewrite(const std::string& input);
+};
+
+#endif //COMPILER_LLVMTARGET_H
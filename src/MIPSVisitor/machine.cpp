@@ -0,0 +1,268 @@
+#include "machine.h"
+#include <llvm/IR/Function.h>
+
+#include <algorithm>
+
+namespace mips
+{
+
+const char* name(Opcode opcode)
+{
+    static constexpr const char* names[] = {
+        "add", "addu", "addiu", "sub", "subu", "mul", "mult", "multu", "div", "divu", "mfhi",
+        "and", "or", "xor", "andi", "ori", "xori", "sll", "srl", "sra",
+        "slt", "sltu", "slti", "sltiu", "sle", "sleu", "sgt", "sgtu", "sge", "sgeu", "seq", "sne",
+        "li", "la", "lw", "lb", "sw", "sb", "lwc1", "swc1", "l.s", "s.s",
+        "move", "movn", "mov.s", "movn.s", "mfc1", "mtc1", "cvt.s.w", "cvt.w.s",
+        "add.s", "sub.s", "mul.s", "div.s", "c.eq.s", "c.lt.s", "c.le.s",
+        "beqz", "bnez", "beq", "bne", "blez", "bgtz", "bltz", "bgez", "j", "jal", "jr"};
+    return names[static_cast<size_t>(opcode)];
+}
+
+std::string label(const llvm::Value* value)
+{
+    if(const auto* ptr = llvm::dyn_cast<llvm::Function>(value)) return ptr->getName();
+    return "g" + std::to_string(reinterpret_cast<size_t>(value)); // nobody can see this line
+}
+
+bool Operand::operator==(const Operand& other) const
+{
+    return kind == other.kind and reg == other.reg and imm == other.imm and block == other.block and symbol == other.symbol;
+}
+
+bool Operand::operator!=(const Operand& other) const
+{
+    return not(*this == other);
+}
+
+Operand reg(int index)
+{
+    Operand operand;
+    operand.kind = Operand::Kind::reg;
+    operand.reg = index;
+    return operand;
+}
+
+Operand imm(int32_t value)
+{
+    Operand operand;
+    operand.kind = Operand::Kind::imm;
+    operand.imm = value;
+    return operand;
+}
+
+Operand address(int32_t offset, int base)
+{
+    Operand operand;
+    operand.kind = Operand::Kind::address;
+    operand.reg = base;
+    operand.imm = offset;
+    return operand;
+}
+
+Operand branchTarget(MachineBlock* block)
+{
+    Operand operand;
+    operand.kind = Operand::Kind::block;
+    operand.block = block;
+    return operand;
+}
+
+Operand symbol(const llvm::Value* value, int32_t offset)
+{
+    Operand operand;
+    operand.kind = Operand::Kind::symbol;
+    operand.symbol = value;
+    operand.imm = offset;
+    return operand;
+}
+
+bool MachineInstruction::isJump() const
+{
+    return opcode == Opcode::j or opcode == Opcode::jr;
+}
+
+int MachineInstruction::getDefinition() const
+{
+    const auto operand = definitionOperand();
+    return operand == -1 ? -1 : operands[operand].reg;
+}
+
+bool MachineInstruction::reads(int index) const
+{
+    if(opcode == Opcode::jal or opcode == Opcode::jr) return true;
+    if(opcode == Opcode::j and operands[0].kind == Operand::Kind::symbol) return true;
+
+    // movn keeps the old value of its destination when the condition is zero
+    const auto keeps = opcode == Opcode::movn or opcode == Opcode::movn_s;
+    const auto definition = definitionOperand();
+    for(int i = 0; i < static_cast<int>(operands.size()); i++)
+    {
+        const auto& operand = operands[i];
+        if(operand.kind == Operand::Kind::address and operand.reg == index) return true;
+        if(operand.kind == Operand::Kind::reg and operand.reg == index and (i != definition or keeps)) return true;
+    }
+    return false;
+}
+
+int MachineInstruction::definitionOperand() const
+{
+    switch(opcode)
+    {
+        case Opcode::sw:
+        case Opcode::sb:
+        case Opcode::swc1:
+        case Opcode::s_s:
+        case Opcode::mult:
+        case Opcode::multu:
+        case Opcode::beqz:
+        case Opcode::bnez:
+        case Opcode::beq:
+        case Opcode::bne:
+        case Opcode::blez:
+        case Opcode::bgtz:
+        case Opcode::bltz:
+        case Opcode::bgez:
+        case Opcode::j:
+        case Opcode::jal:
+        case Opcode::jr:
+            return -1;
+        case Opcode::div:
+        case Opcode::divu:
+            // without a destination the quotient and remainder go to lo and hi
+            return operands[2].kind == Operand::Kind::none ? -1 : 0;
+        case Opcode::mtc1:
+            // the float register is written, whichever side it is on
+            return operands[0].reg >= 32 ? 0 : 1;
+        default:
+            return operands[0].kind == Operand::Kind::reg ? 0 : -1;
+    }
+}
+
+MachineInstruction* MachineBlock::append(Opcode opcode, Operand t1, Operand t2, Operand t3)
+{
+    return instructions.emplace_back(function->create(opcode, t1, t2, t3));
+}
+
+void MachineBlock::appendMove(int to, int from)
+{
+    if(to == from) return;
+
+    if(from >= 32) append(to >= 32 ? Opcode::mov_s : Opcode::mfc1, reg(to), reg(from));
+    else append(to >= 32 ? Opcode::mtc1 : Opcode::move, reg(to), reg(from));
+}
+
+const std::string& MachineBlock::getName() const noexcept
+{
+    return name;
+}
+
+std::vector<MachineInstruction*>& MachineBlock::getInstructions() noexcept
+{
+    return instructions;
+}
+
+const std::vector<MachineInstruction*>& MachineBlock::getInstructions() const noexcept
+{
+    return instructions;
+}
+
+const std::vector<MachineBlock*>& MachineBlock::getSuccessors() const noexcept
+{
+    return successors;
+}
+
+MachineBlock* MachineFunction::appendBlock(std::string name)
+{
+    return blocks.emplace_back(std::make_unique<MachineBlock>(this, std::move(name))).get();
+}
+
+MachineInstruction* MachineFunction::create(Opcode opcode, Operand t1, Operand t2, Operand t3)
+{
+    return &pool.emplace_back(MachineInstruction{opcode, {t1, t2, t3}});
+}
+
+void MachineFunction::link()
+{
+    for(size_t i = 0; i < blocks.size(); i++)
+    {
+        auto& successors = blocks[i]->successors;
+        successors.clear();
+
+        const auto& instructions = blocks[i]->instructions;
+        for(const auto* instruction : instructions)
+        {
+            for(const auto& operand : instruction->operands)
+            {
+                if(operand.kind != Operand::Kind::block) continue;
+                if(std::find(successors.begin(), successors.end(), operand.block) == successors.end())
+                {
+                    successors.push_back(operand.block);
+                }
+            }
+        }
+        const auto fallsThrough = instructions.empty() or not instructions.back()->isJump();
+        if(fallsThrough and i + 1 < blocks.size() and
+           std::find(successors.begin(), successors.end(), blocks[i + 1].get()) == successors.end())
+        {
+            successors.push_back(blocks[i + 1].get());
+        }
+    }
+}
+
+void MachineFunction::print(std::ostream& os) const
+{
+    for(const auto& block : blocks)
+    {
+        os << block->name << ":\n";
+        for(const auto* instruction : block->instructions)
+        {
+            os << *instruction << '\n';
+        }
+    }
+}
+
+const std::vector<std::unique_ptr<MachineBlock>>& MachineFunction::getBlocks() const noexcept
+{
+    return blocks;
+}
+
+std::ostream& operator<<(std::ostream& os, const Operand& operand)
+{
+    const auto printRegister = [&](int index) -> std::ostream& {
+        if(index == 29) return os << "$sp";
+        if(index == 31) return os << "$ra";
+        return os << (index >= 32 ? "$f" : "$") << index % 32;
+    };
+
+    switch(operand.kind)
+    {
+        case Operand::Kind::none:
+            return os;
+        case Operand::Kind::reg:
+            return printRegister(operand.reg);
+        case Operand::Kind::imm:
+            return os << operand.imm;
+        case Operand::Kind::address:
+            os << operand.imm << '(';
+            return printRegister(operand.reg) << ')';
+        case Operand::Kind::block:
+            return os << operand.block->getName();
+        case Operand::Kind::symbol:
+            os << label(operand.symbol);
+            return operand.imm == 0 ? os : os << '+' << operand.imm;
+    }
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const MachineInstruction& instruction)
+{
+    os << name(instruction.opcode);
+    for(size_t i = 0; i < instruction.operands.size() and instruction.operands[i].kind != Operand::Kind::none; i++)
+    {
+        os << (i == 0 ? " " : ",") << instruction.operands[i];
+    }
+    return os;
+}
+
+} // namespace mips
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm
+{
+class Value;
+} // namespace llvm
+
+namespace mips
+{
+
+class MachineBlock;
+class MachineFunction;
+
+// every instruction the backend emits, a '_' in the name is printed as a '.'
+enum class Opcode
+{
+    add, addu, addiu, sub, subu, mul, mult, multu, div, divu, mfhi,
+    and_, or_, xor_, andi, ori, xori, sll, srl, sra,
+    slt, sltu, slti, sltiu, sle, sleu, sgt, sgtu, sge, sgeu, seq, sne,
+    li, la, lw, lb, sw, sb, lwc1, swc1, l_s, s_s,
+    move, movn, mov_s, movn_s, mfc1, mtc1, cvt_s_w, cvt_w_s,
+    add_s, sub_s, mul_s, div_s, c_eq_s, c_lt_s, c_le_s,
+    beqz, bnez, beq, bne, blez, bgtz, bltz, bgez, j, jal, jr
+};
+
+[[nodiscard]] const char* name(Opcode opcode);
+
+// the label of a function, global variable, float constant or basic block in the assembly
+[[nodiscard]] std::string label(const llvm::Value* value);
+
+struct Operand
+{
+    enum class Kind
+    {
+        none, reg, imm, address, block, symbol
+    };
+
+    Kind kind = Kind::none;
+
+    // the register, or the base register of an address, the float registers are numbered from 32
+    int reg = 0;
+    // the immediate, or the offset of an address or symbol
+    int32_t imm = 0;
+
+    MachineBlock* block = nullptr;
+    const llvm::Value* symbol = nullptr;
+
+    bool operator==(const Operand& other) const;
+    bool operator!=(const Operand& other) const;
+};
+
+[[nodiscard]] Operand reg(int index);
+[[nodiscard]] Operand imm(int32_t value);
+[[nodiscard]] Operand address(int32_t offset, int base);
+[[nodiscard]] Operand branchTarget(MachineBlock* block);
+[[nodiscard]] Operand symbol(const llvm::Value* value, int32_t offset = 0);
+
+struct MachineInstruction
+{
+    Opcode opcode;
+    std::array<Operand, 3> operands;
+
+    // j and jr never fall through to the next instruction
+    [[nodiscard]] bool isJump() const;
+
+    // the register the instruction writes, or -1, the registers a call overwrites are not counted
+    [[nodiscard]] int getDefinition() const;
+
+    // calls and jumps out of the function are assumed to read every register
+    [[nodiscard]] bool reads(int index) const;
+
+    private:
+    // the operand that holds the definition, or -1
+    [[nodiscard]] int definitionOperand() const;
+};
+
+class MachineBlock
+{
+    public:
+    explicit MachineBlock(MachineFunction* function, std::string name) : function(function), name(std::move(name))
+    {
+    }
+
+    MachineInstruction* append(Opcode opcode, Operand t1 = {}, Operand t2 = {}, Operand t3 = {});
+
+    // a move between two registers of any class, nothing when they are the same
+    void appendMove(int to, int from);
+
+    [[nodiscard]] const std::string& getName() const noexcept;
+
+    [[nodiscard]] std::vector<MachineInstruction*>& getInstructions() noexcept;
+    [[nodiscard]] const std::vector<MachineInstruction*>& getInstructions() const noexcept;
+
+    // the blocks this one branches or falls through to, known after MachineFunction::link
+    [[nodiscard]] const std::vector<MachineBlock*>& getSuccessors() const noexcept;
+
+    private:
+    friend class MachineFunction;
+
+    MachineFunction* function;
+    std::string name;
+    std::vector<MachineInstruction*> instructions;
+    std::vector<MachineBlock*> successors;
+};
+
+// the instructions of a function after register allocation, the text is only produced when it is printed
+class MachineFunction
+{
+    public:
+    MachineBlock* appendBlock(std::string name);
+
+    // the instructions are allocated in chunks that never move, the blocks only point into them
+    MachineInstruction* create(Opcode opcode, Operand t1, Operand t2, Operand t3);
+
+    // the successors of a block are the blocks it branches to and the next one when its last instruction is no jump
+    void link();
+
+    void print(std::ostream& os) const;
+
+    [[nodiscard]] const std::vector<std::unique_ptr<MachineBlock>>& getBlocks() const noexcept;
+
+    private:
+    std::deque<MachineInstruction> pool;
+    std::vector<std::unique_ptr<MachineBlock>> blocks;
+};
+
+std::ostream& operator<<(std::ostream& os, const Operand& operand);
+std::ostream& operator<<(std::ostream& os, const MachineInstruction& instruction);
+
+} // namespace mips
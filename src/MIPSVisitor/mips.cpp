@@ -7,60 +7,272 @@
 #include "mips.h"
 #include "../errors.h"
 #include <llvm/ADT/StringExtras.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/CFG.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/Type.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <cmath>
+#include <limits>
+
 namespace
 {
-std::string reg(uint num)
+using mips::imm;
+using mips::MachineBlock;
+using mips::Opcode;
+using mips::reg;
+
+bool isFloat(llvm::Value* value)
 {
-    return (num >= 32 ? "$f" : "$") + std::to_string(num % 32);
+    return value->getType()->isFloatTy();
 }
 
-template <typename Ptr>
-std::string label(Ptr* ptr)
+bool isZero(llvm::Value* value)
 {
-    return "g" + std::to_string(reinterpret_cast<size_t>(ptr)); // nobody can see this line
+    const auto* constant = llvm::dyn_cast<llvm::ConstantInt>(value);
+    return (constant != nullptr and constant->isZero()) or llvm::isa<llvm::ConstantPointerNull>(value) or
+           llvm::isa<llvm::UndefValue>(value);
 }
 
-std::string label(llvm::Function* ptr)
+// booleans are 0 or 1 like the results of the set instructions, so true is not sign extended to -1
+int32_t immediate(const llvm::ConstantInt* constant)
 {
-    return ptr->getName();
+    return constant->getBitWidth() == 1 ? int32_t(constant->getZExtValue()) : int32_t(constant->getSExtValue());
 }
 
-std::string operation(std::string&& operation, std::string&& t1 = "", std::string&& t2 = "", std::string&& t3 = "")
+// the instruction that takes the constant as its 16 bit immediate, or the opcode itself when there is none, a
+// subtraction adds the negated constant
+Opcode immediateForm(Opcode opcode, int32_t& value)
 {
-    std::string res = (operation + ' ');
-    if(not t1.empty()) res += t1 + ",";
-    if(not t2.empty()) res += t2 + ",";
-    if(not t3.empty()) res += t3 + ",";
-    res.back() = '\n';
-    return res;
+    const auto fitsSigned = value >= -32768 and value <= 32767;
+    const auto fitsUnsigned = value >= 0 and value <= 65535;
+    switch(opcode)
+    {
+        case Opcode::add:
+        case Opcode::addu:
+            return fitsSigned ? Opcode::addiu : opcode;
+        case Opcode::sub:
+        case Opcode::subu:
+            if(value < -32767 or value > 32768) return opcode;
+            value = -value;
+            return Opcode::addiu;
+        case Opcode::and_:
+            return fitsUnsigned ? Opcode::andi : opcode;
+        case Opcode::or_:
+            return fitsUnsigned ? Opcode::ori : opcode;
+        case Opcode::xor_:
+            return fitsUnsigned ? Opcode::xori : opcode;
+        case Opcode::slt:
+            return fitsSigned ? Opcode::slti : opcode;
+        case Opcode::sltu:
+            return fitsSigned ? Opcode::sltiu : opcode;
+        default:
+            return opcode;
+    }
 }
 
-std::string move(uint to, uint from)
+// moves the registers as if it happens at once, a cycle is broken through the temp register of its class
+void parallelMove(MachineBlock& output, std::vector<std::pair<int, int>> moves, const std::array<int, 2>& temps)
 {
-    if(to == from) return "";
+    const auto isNoop = [](const auto& pending) { return pending.first == pending.second; };
+    moves.erase(std::remove_if(moves.begin(), moves.end(), isNoop), moves.end());
+
+    while(not moves.empty())
+    {
+        // a register that no other move still reads can be overwritten
+        const auto isRead = [&](int index) {
+            return std::any_of(moves.begin(), moves.end(), [&](const auto& pending) { return pending.second == index; });
+        };
+        const auto free = std::find_if(moves.begin(), moves.end(), [&](const auto& pending) { return not isRead(pending.first); });
+        if(free != moves.end())
+        {
+            output.appendMove(free->first, free->second);
+            moves.erase(free);
+            continue;
+        }
 
-    const auto tofl = to >= 32;
-    const auto frfl = from >= 32;
+        const auto from = moves.front().second;
+        const auto temp = temps[from >= 32];
+        output.appendMove(temp, from);
+        for(auto& pending : moves)
+        {
+            if(pending.second == from) pending.second = temp;
+        }
+    }
+}
 
-    if(frfl)
+// to = from * constant, scratch may be used as an extra register, to and from may be the same
+void multiply(MachineBlock& output, int to, int from, int32_t constant, int scratch)
+{
+    const auto negative = constant < 0;
+    const auto value = negative ? -static_cast<uint32_t>(constant) : static_cast<uint32_t>(constant);
+    const auto log = [](uint32_t x) { return imm(31 - __builtin_clz(x)); };
+    const auto shift = [&](int to, uint32_t power) {
+        if(power == 1) output.appendMove(to, from);
+        else output.append(Opcode::sll, reg(to), reg(from), log(power));
+    };
+
+    if(value == 0)
     {
-        return operation(tofl ? "mov.s" : "mfc1", reg(to), reg(from));
+        output.append(Opcode::move, reg(to), reg(0));
+        return;
+    }
+    else if((value & (value - 1)) == 0)
+    {
+        shift(to, value);
+    }
+    else if(const auto low = value & -value; ((value - low) & (value - low - 1)) == 0)
+    {
+        // two bits set: (from << a) + (from << b)
+        output.append(Opcode::sll, reg(scratch), reg(from), log(value - low));
+        shift(to, low);
+        output.append(Opcode::addu, reg(to), reg(to), reg(scratch));
+    }
+    else if(((value + low) & (value + low - 1)) == 0 and value + low != 0)
+    {
+        // a run of bits: (from << a) - (from << b)
+        output.append(Opcode::sll, reg(scratch), reg(from), log(value + low));
+        shift(to, low);
+        output.append(Opcode::subu, reg(to), reg(scratch), reg(to));
     }
     else
     {
-        return operation(tofl ? "mtc1" : "move", reg(to), reg(from));
+        output.append(Opcode::li, reg(scratch), imm(constant));
+        output.append(Opcode::mul, reg(to), reg(from), reg(scratch));
+        return;
     }
+
+    if(negative) output.append(Opcode::subu, reg(to), reg(0), reg(to));
 }
 
-bool isFloat(llvm::Value* value)
+// magic numbers for division by constants, see Hacker's Delight chapter 10
+std::pair<int32_t, int> signedMagic(int32_t divisor)
 {
-    return value->getType()->isFloatTy();
+    const uint32_t two31 = 0x80000000u;
+    const uint32_t ad = divisor < 0 ? -static_cast<uint32_t>(divisor) : divisor;
+    const uint32_t t = two31 + (static_cast<uint32_t>(divisor) >> 31u);
+    const uint32_t anc = t - 1 - t % ad;
+
+    auto p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do
+    {
+        p++;
+        q1 *= 2; r1 *= 2;
+        if(r1 >= anc) { q1++; r1 -= anc; }
+        q2 *= 2; r2 *= 2;
+        if(r2 >= ad) { q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while(q1 < delta or (q1 == delta and r1 == 0));
+
+    const auto magic = static_cast<int32_t>(q2 + 1);
+    return {divisor < 0 ? -magic : magic, p - 32};
+}
+
+std::tuple<uint32_t, int, bool> unsignedMagic(uint32_t divisor)
+{
+    auto add = false;
+    auto p = 31;
+    uint32_t p32 = 0, delta;
+    uint32_t q = 0x7FFFFFFFu / divisor, r = 0x7FFFFFFFu - q * divisor;
+    do
+    {
+        p++;
+        p32 = (p == 32) ? 1 : 2 * p32;
+        if(r + 1 >= divisor - r)
+        {
+            if(q >= 0x7FFFFFFFu) add = true;
+            q = 2 * q + 1;
+            r = 2 * r + 1 - divisor;
+        }
+        else
+        {
+            if(q >= 0x80000000u) add = true;
+            q = 2 * q;
+            r = 2 * r + 1;
+        }
+        delta = divisor - 1 - r;
+    } while(p < 64 and p32 < delta);
+
+    return {q + 1, p - 32, add};
+}
+
+// to = from / constant, to and from must be different registers
+void divide(MachineBlock& output, int to, int from, int32_t constant, bool isSigned, int scratch)
+{
+    if(isSigned)
+    {
+        const auto value = constant < 0 ? -static_cast<uint32_t>(constant) : static_cast<uint32_t>(constant);
+        if(value == 1)
+        {
+            output.appendMove(to, from);
+        }
+        else if((value & (value - 1)) == 0)
+        {
+            // round towards zero by adding value - 1 to negative numbers
+            const auto shift = 31 - __builtin_clz(value);
+            output.append(Opcode::sra, reg(scratch), reg(from), imm(31));
+            output.append(Opcode::srl, reg(scratch), reg(scratch), imm(32 - shift));
+            output.append(Opcode::addu, reg(scratch), reg(from), reg(scratch));
+            output.append(Opcode::sra, reg(to), reg(scratch), imm(shift));
+        }
+        else
+        {
+            const auto [magic, shift] = signedMagic(constant);
+            output.append(Opcode::li, reg(scratch), imm(magic));
+            output.append(Opcode::mult, reg(from), reg(scratch));
+            output.append(Opcode::mfhi, reg(to));
+            if(constant > 0 and magic < 0) output.append(Opcode::addu, reg(to), reg(to), reg(from));
+            if(constant < 0 and magic > 0) output.append(Opcode::subu, reg(to), reg(to), reg(from));
+            if(shift > 0) output.append(Opcode::sra, reg(to), reg(to), imm(shift));
+            output.append(Opcode::srl, reg(scratch), reg(to), imm(31));
+            output.append(Opcode::addu, reg(to), reg(to), reg(scratch));
+            return;
+        }
+        if(constant < 0) output.append(Opcode::subu, reg(to), reg(0), reg(to));
+        return;
+    }
+
+    const auto value = static_cast<uint32_t>(constant);
+    if(value == 1)
+    {
+        output.appendMove(to, from);
+    }
+    else if((value & (value - 1)) == 0)
+    {
+        output.append(Opcode::srl, reg(to), reg(from), imm(31 - __builtin_clz(value)));
+    }
+    else if(value >= 0x80000000u)
+    {
+        // the quotient can only be 0 or 1
+        output.append(Opcode::li, reg(scratch), imm(constant));
+        output.append(Opcode::sltu, reg(to), reg(from), reg(scratch));
+        output.append(Opcode::xori, reg(to), reg(to), imm(1));
+    }
+    else
+    {
+        const auto [magic, shift, add] = unsignedMagic(value);
+        output.append(Opcode::li, reg(scratch), imm(static_cast<int32_t>(magic)));
+        output.append(Opcode::multu, reg(from), reg(scratch));
+        output.append(Opcode::mfhi, reg(to));
+        if(add)
+        {
+            output.append(Opcode::subu, reg(scratch), reg(from), reg(to));
+            output.append(Opcode::srl, reg(scratch), reg(scratch), imm(1));
+            output.append(Opcode::addu, reg(scratch), reg(scratch), reg(to));
+            output.append(Opcode::srl, reg(to), reg(scratch), imm(shift - 1));
+        }
+        else if(shift > 0)
+        {
+            output.append(Opcode::srl, reg(to), reg(to), imm(shift));
+        }
+    }
 }
 
 } // namespace
@@ -68,256 +280,567 @@ bool isFloat(llvm::Value* value)
 namespace mips
 {
 
+std::vector<int> argumentRegisters(llvm::Function* function)
+{
+    std::array<std::vector<int>, 2> available = {std::vector<int>{4, 5, 6, 7}, std::vector<int>{32 + 12, 32 + 14}};
+    std::array<size_t, 2> used = {0, 0};
+
+    std::vector<int> registers;
+    for(auto& arg : function->args())
+    {
+        const auto fl = isFloat(&arg);
+        registers.push_back(used[fl] < available[fl].size() ? available[fl][used[fl]++] : -1);
+    }
+    return registers;
+}
+
 RegisterMapper::RegisterMapper(Module* module, llvm::Function* function)
 : module(module), function(function)
 {
-    emptyRegisters[0].resize(end[0] - start[0]);
-    std::iota(emptyRegisters[0].begin(), emptyRegisters[0].end(), start[0]);
+}
 
-    emptyRegisters[1].resize(end[1] - start[1]);
-    std::iota(emptyRegisters[1].begin(), emptyRegisters[1].end(), start[1]);
+void RegisterMapper::allocate(Function* owner, Allocator allocator)
+{
+    llvm::DominatorTree tree(*function);
+    llvm::LoopInfo loops(tree);
+    for(const auto& block : owner->getBlocks())
+    {
+        block->depth = loops.getLoopDepth(block->getBlock());
+    }
 
-    savedRegisters[0] = std::vector<int>(32, -1);
-    savedRegisters[1] = std::vector<int>(32, -1);
+    const auto live = liveness(owner);
+    auto intervals = liveIntervals(owner, live);
 
-    registerValues[0] = std::vector<llvm::Value*>(32, nullptr);
-    registerValues[1] = std::vector<llvm::Value*>(32, nullptr);
+    RegisterFile registers;
+    for(auto fl : {0, 1})
+    {
+        registers.callerSaved[fl].resize(calleeSaved[fl] - start[fl]);
+        std::iota(registers.callerSaved[fl].begin(), registers.callerSaved[fl].end(), start[fl]);
+        registers.calleeSaved[fl].resize(end[fl] - calleeSaved[fl]);
+        std::iota(registers.calleeSaved[fl].begin(), registers.calleeSaved[fl].end(), calleeSaved[fl]);
+    }
 
+    // the arguments and the operands of calls prefer the register they are passed in
+    const auto setHint = [&](llvm::Value* value, int index) {
+        if(index == -1 or not isRegisterValue(value)) return;
+        auto& interval = intervals[live.indices.at(value)];
+        if(interval.hint == -1) interval.hint = index % 32;
+    };
+    for(auto& arg : function->args())
+    {
+        if(live.indices.count(&arg)) setHint(&arg, argumentRegisters(function)[arg.getArgNo()]);
+    }
+    // a function without calls that jump with jal keeps $ra, the frame has room for the most stack arguments
+    bool leaf = true;
+    int outgoing = 0;
+    for(const auto& block : owner->getBlocks())
+    {
+        for(const auto& instruction : block->getInstructions())
+        {
+            const auto* call = dynamic_cast<const Call*>(instruction.get());
+            if(call == nullptr) continue;
+            for(const auto& [value, index] : call->getRegisterArguments()) setHint(value, index);
+            leaf = leaf and call->isSibling();
+            outgoing = std::max(outgoing, call->getStackSize());
+            clobbers |= call->getClobbers();
+        }
+    }
+
+    if(allocator == Allocator::graph)
+    {
+        graphColoring(owner, live, intervals, registers);
+    }
+    else
+    {
+        linearScan(intervals, registers);
+    }
+
+    std::map<llvm::Value*, int> slots;
+    const auto slotCount = assignSpillSlots(intervals, slots);
+
+    // the frame holds the outgoing arguments, the saved registers, the spill slots and the allocas, from the stack
+    // pointer up, only the callee saved registers are saved as the caller does not expect the others to survive
+    std::array<std::set<int>, 2> assigned;
+    for(const auto& interval : intervals)
+    {
+        if(interval.reg == -1)
+        {
+            statistics.values++;
+            continue;
+        }
+        registerDescriptors[interval.fl].emplace(interval.value, interval.reg);
+        if(interval.reg >= calleeSaved[interval.fl]) assigned[interval.fl].insert(interval.reg);
+        else clobbers.set(interval.reg + 32 * interval.fl);
+    }
+
+    frameSize = outgoing;
+    for(auto fl : {0, 1})
+    {
+        for(const auto index : assigned[fl])
+        {
+            savedRegisters.emplace_back(index + 32 * fl, frameSize);
+            frameSize += 4;
+        }
+    }
+    if(not leaf)
+    {
+        savedRegisters.emplace_back(31, frameSize);
+        frameSize += 4;
+    }
+    for(const auto& interval : intervals)
+    {
+        if(const auto iter = slots.find(interval.value); iter != slots.end())
+        {
+            addressDescriptors[interval.fl].emplace(interval.value, frameSize + 4 * iter->second);
+        }
+    }
+    frameSize += 4 * slotCount;
+
+    // a spilled argument that came in a register is stored in the prologue
+    const auto incoming = argumentRegisters(function);
     for(auto& arg : function->args())
     {
         const auto fl = isFloat(&arg);
-        argsSize += 4;
-        addressDescriptors[fl].emplace(&arg, function->arg_size() * 4 - argsSize);
+        if(incoming[arg.getArgNo()] == -1 or registerDescriptors[fl].count(&arg) or arg.use_empty()) continue;
+        addressDescriptors[fl].emplace(&arg, frameSize);
+        frameSize += 4;
+    }
+
+    for(const auto& [value, size] : allocas)
+    {
+        pointerDescriptors.emplace(value, frameSize);
+        frameSize += size;
+    }
+
+    // the caller leaves the stack arguments at the bottom of its frame, right above ours
+    int stacked = 0;
+    for(auto& arg : function->args())
+    {
+        if(incoming[arg.getArgNo()] == -1) addressDescriptors[isFloat(&arg)].emplace(&arg, frameSize + 4 * stacked++);
     }
+    shrinkWrap(owner, tree, loops);
 }
 
-int RegisterMapper::loadValue(std::string& output, llvm::Value* id)
+void RegisterMapper::shrinkWrap(Function* owner, llvm::DominatorTree& tree, const llvm::LoopInfo& loops)
 {
-    const auto fl = isFloat(id);
-    const auto result = [&](auto r) { return r + 32 * fl; };
+    // the arguments are put in their place before any block runs, so none of them may be in the frame
+    const auto incoming = argumentRegisters(function);
+    for(auto& arg : function->args())
+    {
+        if(incoming[arg.getArgNo()] == -1 or addressDescriptors[isFloat(&arg)].count(&arg)) return;
+    }
 
-    // try to place constant value into temp register and be done with it
-    // this short circuits everything, so we don't need t handle any descriptors
-    const auto tmp = getTempRegister(isFloat(id));
-    if(placeConstant(output, tmp, id))
+    // a block needs the frame when it calls with jal, or touches a callee saved register or the stack
+    const auto needsFrame = [&](llvm::Value* value) {
+        const auto fl = isFloat(value);
+        if(llvm::isa<llvm::Argument>(value)) return false;
+        if(const auto iter = registerDescriptors[fl].find(value); iter != registerDescriptors[fl].end())
+        {
+            return iter->second >= calleeSaved[fl];
+        }
+        return addressDescriptors[fl].count(value) != 0 or pointerDescriptors.count(value) != 0;
+    };
+    const auto usesFrame = [&](const auto& instruction) {
+        const auto* call = dynamic_cast<const Call*>(instruction.get());
+        const auto& uses = instruction->getUses();
+        const auto& defs = instruction->getDefs();
+        return (call != nullptr and not call->isSibling()) or std::any_of(uses.begin(), uses.end(), needsFrame) or
+               std::any_of(defs.begin(), defs.end(), needsFrame);
+    };
+
+    llvm::BasicBlock* save = nullptr;
+    for(const auto& block : owner->getBlocks())
     {
-        return tmp;
+        const auto& instructions = block->getInstructions();
+        if(not tree.isReachableFromEntry(block->getBlock())) continue;
+        if(std::none_of(instructions.begin(), instructions.end(), usesFrame)) continue;
+        save = save == nullptr ? block->getBlock() : tree.findNearestCommonDominator(save, block->getBlock());
     }
+    if(save == nullptr) return;
 
-    // we try to find if it is stored in a register already, if so just return it
-    if(const auto iter = registerDescriptors[fl].find(id); iter != registerDescriptors[fl].end())
+    // the save point may not be in a loop and the region it dominates may only be left over an edge from a block
+    // without other successors, where the frame is freed again
+    const auto leavesCleanly = [&](llvm::BasicBlock* point) {
+        for(auto& block : *function)
+        {
+            if(not tree.isReachableFromEntry(&block) or not tree.dominates(point, &block)) continue;
+            const auto outside = [&](auto* successor) { return not tree.dominates(point, successor); };
+            if(block.getTerminator()->getNumSuccessors() > 1 and llvm::any_of(llvm::successors(&block), outside))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    while(save != &function->getEntryBlock() and (loops.getLoopDepth(save) != 0 or not leavesCleanly(save)))
     {
-        return result(iter->second);
+        save = tree.getNode(save)->getIDom()->getBlock();
     }
+    if(save == &function->getEntryBlock()) return;
 
-    // we try to find a suitable register, either by finding an empty one or spilling another one
-    auto index = -1;
-    if(emptyRegisters[fl].empty())
+    // the blocks that run after the region has been left
+    std::set<llvm::BasicBlock*> after;
+    std::vector<llvm::BasicBlock*> worklist(llvm::succ_begin(save), llvm::succ_end(save));
+    while(not worklist.empty())
     {
-        // if there are no registers left, we spill a value
-        index = getNextSpill(fl);
-        const auto spilled = registerValues[fl][index];
+        auto* block = worklist.back();
+        worklist.pop_back();
+        if(tree.dominates(save, block) or not after.insert(block).second) continue;
+        worklist.insert(worklist.end(), llvm::succ_begin(block), llvm::succ_end(block));
+    }
 
-        if(const auto addr = pointerDescriptors[fl].find(spilled); addr != pointerDescriptors[fl].end())
+    // an argument in a callee saved register stays in the register it came in until the save point, as long as it
+    // is not used after the region and nothing else is put in that register before
+    std::map<llvm::Value*, int> splits;
+    for(auto& arg : function->args())
+    {
+        const auto fl = isFloat(&arg);
+        const auto iter = registerDescriptors[fl].find(&arg);
+        if(iter != registerDescriptors[fl].end() and iter->second >= calleeSaved[fl])
         {
-            // we store the value we needed to spill into the allocated memory
-            output += operation(fl ? "swc1" : "sw", reg(result(index)), std::to_string(addr->second) + "($sp)");
+            splits.emplace(&arg, incoming[arg.getArgNo()]);
         }
-        else
+    }
+    for(const auto& [value, index] : splits)
+    {
+        const auto overwrites = [&, index = index](llvm::Value* other) {
+            const auto fl = isFloat(other);
+            const auto iter = registerDescriptors[fl].find(other);
+            return other != value and iter != registerDescriptors[fl].end() and iter->second + 32 * fl == index;
+        };
+        for(auto& arg : function->args())
         {
-            // we find the location to spill to, and increase saveSize if we did
-            const auto iter = addressDescriptors[fl].try_emplace(spilled, argsSize + saveSize);
-            if(iter.second)
-                saveSize += 4;
-
-            // we add the spilled value to the data structures
-            output += operation(fl ? "swc1" : "sw", reg(result(index)),
-                                std::to_string(iter.first->second) + "($sp)");
+            if(overwrites(&arg)) return;
+        }
+        for(const auto& block : owner->getBlocks())
+        {
+            if(tree.dominates(save, block->getBlock())) continue;
+            for(const auto& instruction : block->getInstructions())
+            {
+                const auto& uses = instruction->getUses();
+                const auto& defs = instruction->getDefs();
+                if(std::any_of(defs.begin(), defs.end(), overwrites)) return;
+                if(after.count(block->getBlock()) and std::count(uses.begin(), uses.end(), value)) return;
+            }
         }
-        // remove the spilled value from the registers
-        registerDescriptors[fl].erase(spilled);
     }
-    else
+
+    savePoint = owner->getBlockByBasicBlock(save);
+    entryRegisters = std::move(splits);
+    for(const auto& block : owner->getBlocks())
     {
-        // if there are left, we use that one and say it is used
-        index = emptyRegisters[fl].back();
-        emptyRegisters[fl].pop_back();
+        const auto outside = [&](auto* successor) { return not tree.dominates(save, successor); };
+        block->framed = tree.dominates(save, block->getBlock());
+        block->restores = block->framed and llvm::any_of(llvm::successors(block->getBlock()), outside);
     }
+}
+
+int RegisterMapper::loadValue(MachineBlock& output, llvm::Value* id)
+{
+    const auto fl = isFloat(id);
 
-    // if it was never used before we need to save it
-    if(registerValues[fl][index] == nullptr)
+    // a value that the instruction already put in a temp register is not loaded again
+    if(const auto iter = temps.find(id); iter != temps.end())
+    {
+        return iter->second;
+    }
+    if(const auto index = findRegister(id); index != -1)
+    {
+        return index;
+    }
+    if(not fl and isZero(id))
     {
-        savedRegisters[fl][index] = argsSize + saveSize;
-        stores += operation(fl ? "swc1" : "sw", reg(result(index)), std::to_string(argsSize + saveSize) + "($sp)");
-        saveSize += 4;
+        return 0;
     }
 
-    // the register will from now on contain this id
-    registerValues[fl][index] = id;
-    registerDescriptors[fl].emplace(id, index);
+    const auto tmp = getTempRegister(fl);
+    placeInTempRegister(output, id, tmp);
+    temps.emplace(id, tmp);
+    return tmp;
+}
 
-    // if the value is on the stack, we can load it in
-    if(const auto address = addressDescriptors[fl].find(id); address != addressDescriptors[fl].end())
+Operand RegisterMapper::loadAddress(MachineBlock& output, llvm::Value* pointer, int offset)
+{
+    if(const auto iter = pointerDescriptors.find(pointer); iter != pointerDescriptors.end())
+    {
+        return address(iter->second + offset, 29);
+    }
+    if(llvm::isa<llvm::GlobalVariable>(pointer))
     {
-        output += operation(fl ? "lwc1" : "lw", reg(result(index)), std::to_string(address->second) + "($sp)");
+        return symbol(pointer, offset);
     }
+    return address(offset, loadValue(output, pointer));
+}
 
-    // if the address was not on the stack, we return the register as is, and it is the problem of the user
-    return result(index);
+int RegisterMapper::defineValue(llvm::Value* id)
+{
+    const auto fl = isFloat(id);
+
+    if(const auto iter = temps.find(id); iter != temps.end())
+    {
+        return iter->second;
+    }
+    if(const auto index = findRegister(id); index != -1)
+    {
+        return index;
+    }
+    if(addressDescriptors[fl].count(id) == 0)
+    {
+        throw InternalError("no register was allocated for a value");
+    }
+
+    // spilled values are computed in a temp register and stored afterwards
+    const auto tmp = getTempRegister(fl);
+    temps.emplace(id, tmp);
+    return tmp;
+}
+
+void RegisterMapper::storeValue(MachineBlock& output, llvm::Value* id)
+{
+    const auto fl = isFloat(id);
+    if(registerDescriptors[fl].count(id)) return;
+
+    const auto slot = addressDescriptors[fl].find(id);
+    const auto tmp = temps.find(id);
+    if(slot == addressDescriptors[fl].end() or tmp == temps.end())
+    {
+        throw InternalError("spilled value was not defined in a temp register");
+    }
+    output.append(tmp->second >= 32 ? Opcode::swc1 : Opcode::sw, reg(tmp->second), address(slot->second, 29));
+    statistics.stores++;
+    statistics.dynamicStores += std::pow(10.0, depth);
 }
 
-void RegisterMapper::loadSaved(std::string& output) const
+void RegisterMapper::saveFrame(MachineBlock& output) const
 {
-    for(size_t i = 0; i < savedRegisters[0].size(); i++)
+    if(frameSize != 0) output.append(Opcode::addiu, reg(29), reg(29), imm(-frameSize));
+    for(const auto& [index, offset] : savedRegisters)
     {
-        if(savedRegisters[0][i] == std::numeric_limits<uint>::max()) continue;
-        output += operation("lw", reg(i), std::to_string(savedRegisters[0][i]) + "($sp)");
+        output.append(index >= 32 ? Opcode::swc1 : Opcode::sw, reg(index), address(offset, 29));
     }
+    for(const auto& [value, index] : entryRegisters)
+    {
+        const auto fl = isFloat(value);
+        output.appendMove(registerDescriptors[fl].at(value) + 32 * fl, index);
+    }
+}
 
-    for(size_t i = 0; i < savedRegisters[1].size(); i++)
+void RegisterMapper::loadSaved(MachineBlock& output) const
+{
+    for(const auto& [index, offset] : savedRegisters)
     {
-        if(savedRegisters[1][i] == std::numeric_limits<uint>::max()) continue;
-        output += operation("lwc1", reg(i + 32), std::to_string(savedRegisters[1][i]) + "($sp)");
+        output.append(index >= 32 ? Opcode::lwc1 : Opcode::lw, reg(index), address(offset, 29));
     }
+    if(frameSize != 0) output.append(Opcode::addiu, reg(29), reg(29), imm(frameSize));
 }
 
-bool RegisterMapper::placeConstant(std::string& output, int index, llvm::Value* id)
+void RegisterMapper::placeInRegisters(MachineBlock& output, const std::vector<std::pair<llvm::Value*, int>>& values)
+{
+    std::vector<std::pair<int, int>> moves;
+    for(const auto& [value, index] : values)
+    {
+        if(const auto from = findRegister(value); from != -1) moves.emplace_back(index, from);
+    }
+    parallelMove(output, std::move(moves), {getTempRegister(false), getTempRegister(true)});
+
+    // constants and spilled values are not in a register that another value is moved from
+    for(const auto& [value, index] : values)
+    {
+        if(findRegister(value) == -1) placeInTempRegister(output, value, index);
+    }
+}
+
+bool RegisterMapper::placeConstant(MachineBlock& output, int index, llvm::Value* id)
 {
     if(const auto& constant = llvm::dyn_cast<llvm::GlobalVariable>(id))
     {
-        output += operation("la", reg(index), label(id));
+        output.append(Opcode::la, reg(index), symbol(id));
         return true;
     }
     else if(const auto& constant = llvm::dyn_cast<llvm::ConstantInt>(id))
     {
-        const auto immediate = int(constant->getSExtValue());
-        output += operation("li", reg(index), std::to_string(immediate));
+        output.append(Opcode::li, reg(index), imm(immediate(constant)));
         return true;
     }
     else if(const auto& constant = llvm::dyn_cast<llvm::ConstantFP>(id))
     {
         module->addFloat(constant);
-        output += operation(index >= 32 ? "l.s" : "lw", reg(index), label(id));
+        output.append(index >= 32 ? Opcode::l_s : Opcode::lw, reg(index), symbol(id));
+        return true;
+    }
+    else if(llvm::isa<llvm::ConstantPointerNull>(id) or llvm::isa<llvm::UndefValue>(id))
+    {
+        output.appendMove(index, 0);
         return true;
     }
 
-    const auto fl = isFloat(id);
-    const auto address = pointerDescriptors[fl].find(id);
-    if(address != pointerDescriptors[fl].end())
+    const auto pointer = pointerDescriptors.find(id);
+    if(pointer != pointerDescriptors.end())
     {
-        output += operation("la", reg(index), std::to_string(address->second) + "($sp)");
+        output.append(Opcode::la, reg(index), address(pointer->second, 29));
         return true;
     }
 
     return false;
 }
 
-void RegisterMapper::placeInTempRegister(std::string& output, llvm::Value* id, int index)
+void RegisterMapper::placeInTempRegister(MachineBlock& output, llvm::Value* id, int index)
 {
     const auto fl = isFloat(id);
 
     if(placeConstant(output, index, id))
     {
     }
-    else if(const auto iter = registerDescriptors[0].find(id); iter != registerDescriptors[0].end())
+    else if(const auto from = findRegister(id); from != -1)
     {
-        output += move(index, iter->second);
+        output.appendMove(index, from);
     }
-    else if(const auto iter = registerDescriptors[1].find(id); iter != registerDescriptors[1].end())
+    else if(const auto slot = addressDescriptors[fl].find(id); slot != addressDescriptors[fl].end())
     {
-        output += move(index, iter->second + 32);
+        output.append(index >= 32 ? Opcode::lwc1 : Opcode::lw, reg(index), address(slot->second, 29));
+        statistics.loads++;
+        statistics.dynamicLoads += std::pow(10.0, depth);
     }
     else
     {
-        try
-        {
-            const auto address = addressDescriptors[fl].at(id);
-            output += operation(index >= 32 ? "lwc1" : "lw", reg(index), std::to_string(address) + "($sp)");
-        }
-        catch(...)
-        {
-            std::string str;
-            llvm::raw_string_ostream rso(str);
-            id->print(rso);
-            throw InternalError("Partial constexpr IR instruction '" + str + "' was not properly converted");
-        }
+        std::string str;
+        llvm::raw_string_ostream rso(str);
+        id->print(rso);
+        throw InternalError("Partial constexpr IR instruction '" + str + "' was not properly converted");
     }
 }
 
 int RegisterMapper::getTempRegister(bool fl)
 {
-    if(not(temp[fl] == 0 or temp[fl] == 1))
+    if(used[fl] == tempRegisters[fl].size())
     {
-        throw InternalError("integer temp register has wrong value for some reason");
+        throw InternalError("an instruction needs more temp registers than there are");
     }
-    const auto tmp = temp[fl];
-    temp[fl] = !temp[fl];
-    return (fl ? 32 : 2) + tmp;
+    return tempRegisters[fl][used[fl]++] + 32 * fl;
 }
 
-int RegisterMapper::getNextSpill(bool fl)
+void RegisterMapper::releaseTempRegisters()
 {
-    spill[fl]++;
-    if(spill[fl] >= end[fl])
-    {
-        spill[fl] = start[fl];
-    }
-    return spill[fl];
+    temps.clear();
+    used = {0, 0};
 }
 
-void RegisterMapper::loadReturnValue(std::string& output, llvm::Value* id)
+void RegisterMapper::loadReturnValue(MachineBlock& output, llvm::Value* id)
 {
     const auto fl = isFloat(id);
-
-    if(const auto iter = registerDescriptors[fl].find(id); iter != registerDescriptors[fl].end())
-    {
-        output += move(iter->second, fl ? 32 : 2);
-    }
-    else if(const auto iter = addressDescriptors[fl].find(id); iter != addressDescriptors[fl].end())
-    {
-        output += operation(fl ? "lwc1" : "lw", reg(fl ? 32 : 2), std::to_string(iter->second) + "($sp)");
-    }
-    else
-    {
-        throw InternalError("unknown llvm value: " + std::to_string(reinterpret_cast<size_t>(id)));
-    }
+    output.appendMove(defineValue(id), fl ? 32 : 2);
+    storeValue(output, id);
 }
 
-void RegisterMapper::storeReturnValue(std::string& output, llvm::Value* id)
+void RegisterMapper::storeReturnValue(MachineBlock& output, llvm::Value* id)
 {
     const auto fl = isFloat(id);
     placeInTempRegister(output, id, fl ? 32 : 2);
 }
 
-void RegisterMapper::allocateValue(std::string& output, llvm::Value* id, llvm::Type* type)
+void RegisterMapper::allocateValue(llvm::Value* id, llvm::Type* type)
+{
+    const auto size = module->layout.getTypeStoreSize(type);
+    allocas.emplace_back(id, static_cast<int>(size + (4u - (size % 4u)) % 4u));
+}
+
+void RegisterMapper::setLoopDepth(unsigned depth)
+{
+    this->depth = depth;
+}
+
+void RegisterMapper::setFramed(bool framed)
+{
+    this->framed = framed;
+}
+
+int RegisterMapper::findRegister(llvm::Value* id) const
 {
     const auto fl = isFloat(id);
-    pointerDescriptors[fl].emplace(id, argsSize + saveSize);
+    if(not framed)
+    {
+        if(const auto iter = entryRegisters.find(id); iter != entryRegisters.end()) return iter->second;
+    }
+    const auto iter = registerDescriptors[fl].find(id);
+    return iter == registerDescriptors[fl].end() ? -1 : iter->second + 32 * fl;
+}
 
-    const auto size = module->layout.getTypeStoreSize(type);
-    const auto realsize = static_cast<int>(size + (4u - (size % 4u)) % 4u);
-    if(realsize % 4 != 0) throw;
-    saveSize += realsize;
+int RegisterMapper::getFrameSize() const noexcept
+{
+    return frameSize;
 }
 
-int RegisterMapper::getSaveSize() const noexcept
+const RegisterMask& RegisterMapper::getClobbers() const noexcept
 {
-    return saveSize;
+    return clobbers;
 }
 
-int RegisterMapper::getArgsSize() const noexcept
+Block* RegisterMapper::getSavePoint() const noexcept
 {
-    return argsSize;
+    return savePoint;
 }
 
-void RegisterMapper::print(std::ostream& os) const
+const SpillStatistics& RegisterMapper::getStatistics() const noexcept
 {
-    os << stores;
+    return statistics;
 }
 
-void Instruction::print(std::ostream& os)
+void RegisterMapper::prologue(MachineBlock& output)
 {
-    os << output;
+    releaseTempRegisters();
+    if(savePoint == nullptr) saveFrame(output);
+
+    // spilled arguments that came in a register go to their slot in the frame, the others move to their register
+    // at once, the arguments that came in the frame of the caller are loaded after that
+    const auto incoming = argumentRegisters(function);
+    std::vector<std::pair<int, int>> moves;
+    std::vector<std::pair<int, int>> loads;
+    for(auto& arg : function->args())
+    {
+        const auto fl = isFloat(&arg);
+        const auto from = incoming[arg.getArgNo()];
+        if(const auto iter = registerDescriptors[fl].find(&arg); iter != registerDescriptors[fl].end())
+        {
+            const auto to = entryRegisters.count(&arg) ? from : iter->second + 32 * fl;
+            if(from != -1) moves.emplace_back(to, from);
+            else loads.emplace_back(to, addressDescriptors[fl].at(&arg));
+        }
+        else if(from != -1 and not arg.use_empty())
+        {
+            output.append(fl ? Opcode::swc1 : Opcode::sw, reg(from), address(addressDescriptors[fl].at(&arg), 29));
+        }
+    }
+    parallelMove(output, std::move(moves), {getTempRegister(false), getTempRegister(true)});
+    for(const auto& [to, offset] : loads)
+    {
+        output.append(to >= 32 ? Opcode::lwc1 : Opcode::lw, reg(to), address(offset, 29));
+    }
+}
+
+void Instruction::lower(MachineBlock& output)
+{
+    mapper()->releaseTempRegisters();
+    emit(output);
+}
+
+const std::vector<llvm::Value*>& Instruction::getUses() const noexcept
+{
+    return uses;
+}
+
+const std::vector<llvm::Value*>& Instruction::getDefs() const noexcept
+{
+    return defs;
+}
+
+bool Instruction::isEarlyClobber() const
+{
+    return false;
+}
+
+RegisterMask Instruction::getClobbers() const
+{
+    return {};
 }
 
 RegisterMapper* Instruction::mapper()
@@ -330,160 +853,510 @@ Module* Instruction::module()
     return block->function->module;
 }
 
-Move::Move(Block* block, llvm::Value* t1, llvm::Value* t2) : Instruction(block)
+llvm::Value* Instruction::use(llvm::Value* value)
+{
+    // the data section with the float constants is printed before the instructions
+    if(auto* constant = llvm::dyn_cast<llvm::ConstantFP>(value)) module()->addFloat(constant);
+    uses.push_back(value);
+    return value;
+}
+
+llvm::Value* Instruction::define(llvm::Value* value)
+{
+    defs.push_back(value);
+    return value;
+}
+
+Move::Move(Block* block, llvm::Value* t1, llvm::Value* t2) : Instruction(block), t1(define(t1)), t2(use(t2))
+{
+}
+
+void Move::emit(MachineBlock& output)
 {
-    const auto index1 = mapper()->loadValue(output, t1);
     const auto index2 = mapper()->loadValue(output, t2);
+    const auto index1 = mapper()->defineValue(t1);
+
+    output.appendMove(index1, index2);
+    mapper()->storeValue(output, t1);
+}
 
-    output += move(index1, index2);
+Convert::Convert(Block* block, llvm::Value* t1, llvm::Value* t2) : Instruction(block), t1(define(t1)), t2(use(t2))
+{
 }
 
-Convert::Convert(Block* block, llvm::Value* t1, llvm::Value* t2) : Instruction(block)
+void Convert::emit(MachineBlock& output)
 {
     // converts t2 into t1
-    const auto index1 = mapper()->loadValue(output, t1);
     const auto index2 = mapper()->loadValue(output, t2);
+    const auto index1 = mapper()->defineValue(t1);
 
     if(isFloat(t2))
     {
-        output += operation("cvt.w.s", reg(index2), reg(index2));
-        output += operation("mfc1", reg(index1), reg(index2));
+        // the conversion happens in a temp register, t2 may still be used later on
+        const auto temp = mapper()->getTempRegister(true);
+        output.append(Opcode::cvt_w_s, reg(temp), reg(index2));
+        output.append(Opcode::mfc1, reg(index1), reg(temp));
     }
     else
     {
-        output += operation("mtc1", reg(index2), reg(index1));
-        output += operation("cvt.s.w", reg(index1), reg(index1));
+        output.append(Opcode::mtc1, reg(index2), reg(index1));
+        output.append(Opcode::cvt_s_w, reg(index1), reg(index1));
     }
+    mapper()->storeValue(output, t1);
 }
 
-Load::Load(Block* block, llvm::Value* t1, llvm::Value* t2) : Instruction(block)
+Load::Load(Block* block, llvm::Value* t1, llvm::Value* t2, int offset)
+: Instruction(block), t1(define(t1)), t2(use(t2)), offset(offset)
 {
-    const auto index1 = mapper()->loadValue(output, t1);
-    const auto index2 = mapper()->loadValue(output, t2);
+}
+
+void Load::emit(MachineBlock& output)
+{
+    const auto pointer = mapper()->loadAddress(output, t2, offset);
+    const auto index1 = mapper()->defineValue(t1);
 
     if(isFloat(t1))
     {
-        output += operation("lwc1", reg(index1), '(' + reg(index2) + ')');
+        output.append(Opcode::lwc1, reg(index1), pointer);
     }
     else
     {
         const bool isWord = module()->layout.getTypeStoreSize(t1->getType()) == 4;
-        output += operation(isWord ? "lw" : "lb", reg(index1), "(" + reg(index2) + ")");
+        output.append(isWord ? Opcode::lw : Opcode::lb, reg(index1), pointer);
     }
+    mapper()->storeValue(output, t1);
 }
 
-Arithmetic::Arithmetic(Block* block, std::string type, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3)
-: Instruction(block)
+Arithmetic::Arithmetic(Block* block, Opcode opcode, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3)
+: Instruction(block), opcode(opcode), t1(define(t1)), t2(use(t2)), t3(use(t3))
 {
-    const auto index1 = mapper()->loadValue(output, t1);
+}
+
+void Arithmetic::emit(MachineBlock& output)
+{
+    if(const auto* constant = llvm::dyn_cast<llvm::ConstantInt>(t3); constant != nullptr and constant->getBitWidth() <= 32)
+    {
+        auto value = immediate(constant);
+        if(const auto form = immediateForm(opcode, value); form != opcode)
+        {
+            const auto index2 = mapper()->loadValue(output, t2);
+            const auto index1 = mapper()->defineValue(t1);
+            output.append(form, reg(index1), reg(index2), imm(value));
+            mapper()->storeValue(output, t1);
+            return;
+        }
+    }
+
     const auto index2 = mapper()->loadValue(output, t2);
     const auto index3 = mapper()->loadValue(output, t3);
+    const auto index1 = mapper()->defineValue(t1);
 
-    output += operation(std::move(type), reg(index1), reg(index2), reg(index3));
+    output.append(opcode, reg(index1), reg(index2), reg(index3));
+    mapper()->storeValue(output, t1);
 }
 
-Modulo::Modulo(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3) : Instruction(block)
+Modulo::Modulo(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3, bool isSigned)
+: Instruction(block), t1(define(t1)), t2(use(t2)), t3(use(t3)), isSigned(isSigned)
+{
+}
+
+void Modulo::emit(MachineBlock& output)
 {
-    const auto index1 = mapper()->loadValue(output, t1);
     const auto index2 = mapper()->loadValue(output, t2);
     const auto index3 = mapper()->loadValue(output, t3);
+    const auto index1 = mapper()->defineValue(t1);
+
+    output.append(isSigned ? Opcode::div : Opcode::divu, reg(index2), reg(index3));
+    output.append(Opcode::mfhi, reg(index1));
+    mapper()->storeValue(output, t1);
+}
+
+Multiply::Multiply(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::ConstantInt* constant)
+: Instruction(block), t1(define(t1)), t2(use(t2)), constant(constant)
+{
+}
+
+void Multiply::emit(MachineBlock& output)
+{
+    const auto index2 = mapper()->loadValue(output, t2);
+    const auto index1 = mapper()->defineValue(t1);
+    const auto scratch = mapper()->getTempRegister(false);
+
+    multiply(output, index1, index2, static_cast<int32_t>(constant->getSExtValue()), scratch);
+    mapper()->storeValue(output, t1);
+}
+
+Divide::Divide(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::ConstantInt* constant, bool isSigned, bool isModulo)
+: Instruction(block), t1(define(t1)), t2(use(t2)), constant(constant), isSigned(isSigned), isModulo(isModulo)
+{
+}
+
+void Divide::emit(MachineBlock& output)
+{
+    const auto index2 = mapper()->loadValue(output, t2);
+    const auto index1 = mapper()->defineValue(t1);
+    const auto scratch = mapper()->getTempRegister(false);
+    const auto value = static_cast<int32_t>(constant->getSExtValue());
+    const auto power = static_cast<uint32_t>(value) & (static_cast<uint32_t>(value) - 1);
+
+    if(isModulo and not isSigned and power == 0 and static_cast<uint32_t>(value) <= 0x10000u)
+    {
+        output.append(Opcode::andi, reg(index1), reg(index2), imm(value - 1));
+    }
+    else
+    {
+        divide(output, index1, index2, value, isSigned, scratch);
+        if(isModulo)
+        {
+            // t2 - (t2 / c) * c
+            multiply(output, index1, index1, value, scratch);
+            output.append(Opcode::subu, reg(index1), reg(index2), reg(index1));
+        }
+    }
+    mapper()->storeValue(output, t1);
+}
+
+bool Divide::isEarlyClobber() const
+{
+    return true;
+}
+
+Offset::Offset(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3, uint64_t size)
+: Instruction(block), t1(define(t1)), t2(use(t2)), t3(use(t3)), size(size)
+{
+}
+
+void Offset::emit(MachineBlock& output)
+{
+    const auto index3 = mapper()->loadValue(output, t3);
+
+    if(t1 == t2)
+    {
+        // accumulating into the result, so the offset needs its own register
+        const auto index1 = mapper()->loadValue(output, t1);
+        const auto temp1 = mapper()->getTempRegister(false);
+        const auto temp2 = mapper()->getTempRegister(false);
+        multiply(output, temp1, index3, static_cast<int32_t>(size), temp2);
+        output.append(Opcode::addu, reg(index1), reg(index1), reg(temp1));
+    }
+    else
+    {
+        const auto index2 = mapper()->loadValue(output, t2);
+        const auto index1 = mapper()->defineValue(t1);
+        multiply(output, index1, index3, static_cast<int32_t>(size), mapper()->getTempRegister(false));
+        output.append(Opcode::addu, reg(index1), reg(index1), reg(index2));
+    }
+    mapper()->storeValue(output, t1);
+}
 
-    output += operation("divu", reg(index2), reg(index3));
-    output += operation("mfhi", reg(index1));
+bool Offset::isEarlyClobber() const
+{
+    return true;
 }
 
 NotEquals::NotEquals(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3)
-: Instruction(block)
+: Instruction(block), t1(define(t1)), t2(use(t2)), t3(use(t3))
+{
+}
+
+void NotEquals::emit(MachineBlock& output)
 {
-    const auto index1 = mapper()->loadValue(output, t1);
     const auto index2 = mapper()->loadValue(output, t2);
     const auto index3 = mapper()->loadValue(output, t3);
+    const auto index1 = mapper()->defineValue(t1);
+
+    output.append(Opcode::c_eq_s, reg(index1), reg(index2), reg(index3));
+    output.append(Opcode::xori, reg(index1), reg(index1), imm(1));
+    mapper()->storeValue(output, t1);
+}
 
-    output += operation("c.eq.s", reg(index1), reg(index2), reg(index3));
-    output += operation("cmp", reg(index1), reg(index1), reg(0));
+Select::Select(Block* block, llvm::Value* t1, llvm::Value* condition, llvm::Value* t2, llvm::Value* t3)
+: Instruction(block), t1(define(t1)), condition(use(condition)), t2(use(t2)), t3(use(t3))
+{
+}
+
+void Select::emit(MachineBlock& output)
+{
+    // t1 = condition ? t2 : t3
+    const auto index2 = mapper()->loadValue(output, condition);
+    const auto index3 = mapper()->loadValue(output, t3);
+    const auto index4 = mapper()->loadValue(output, t2);
+    const auto index1 = mapper()->defineValue(t1);
+
+    output.appendMove(index1, index3);
+    output.append(isFloat(t1) ? Opcode::movn_s : Opcode::movn, reg(index1), reg(index4), reg(index2));
+    mapper()->storeValue(output, t1);
+}
+
+bool Select::isEarlyClobber() const
+{
+    return true;
 }
 
 Branch::Branch(Block* block, llvm::Value* t1, llvm::BasicBlock* target, bool eqZero)
-: Instruction(block)
+: Instruction(block), t1(use(t1)), target(target), eqZero(eqZero)
+{
+}
+
+void Branch::emit(MachineBlock& output)
 {
     const auto index1 = mapper()->loadValue(output, t1);
 
-    output += operation(eqZero ? "beqz" : "bnez", reg(index1), label(target));
+    output.append(eqZero ? Opcode::beqz : Opcode::bnez, reg(index1), branchTarget(block->function->getMachineBlock(target)));
 }
 
-Call::Call(Block* block, llvm::Function* function, std::vector<llvm::Value*>&& arguments, llvm::Value* ret)
-: Instruction(block), function(function), arguments(std::move(arguments)), ret(ret)
+CompareBranch::CompareBranch(Block* block, llvm::CmpInst::Predicate predicate, llvm::Value* t1, llvm::Value* t2, llvm::BasicBlock* target)
+: Instruction(block), predicate(predicate), t1(use(t1)), t2(use(t2)), target(target)
 {
-    for(auto arg : this->arguments)
+}
+
+void CompareBranch::emit(MachineBlock& output)
+{
+    // branches when t1 predicate t2 holds, a constant is put on the right
+    auto kind = predicate;
+    auto* lhs = t1;
+    auto* rhs = t2;
+    if(llvm::isa<llvm::Constant>(lhs) and not llvm::isa<llvm::Constant>(rhs))
     {
-        std::string temp;
-        mapper()->placeInTempRegister(temp, arg, 2);
-        loads.emplace_back(temp);
+        std::swap(lhs, rhs);
+        kind = llvm::CmpInst::getSwappedPredicate(kind);
     }
+    const auto label = branchTarget(block->function->getMachineBlock(target));
+
+    // no unsigned value is below zero
+    if(isZero(rhs) and kind == llvm::CmpInst::ICMP_UGT) kind = llvm::CmpInst::ICMP_NE;
+    if(isZero(rhs) and kind == llvm::CmpInst::ICMP_ULE) kind = llvm::CmpInst::ICMP_EQ;
 
-    mapper()->loadValue(output, ret);
+    if(kind == llvm::CmpInst::ICMP_EQ or kind == llvm::CmpInst::ICMP_NE)
+    {
+        const auto equal = kind == llvm::CmpInst::ICMP_EQ;
+        const auto index1 = mapper()->loadValue(output, lhs);
+        if(isZero(rhs))
+        {
+            output.append(equal ? Opcode::beqz : Opcode::bnez, reg(index1), label);
+        }
+        else
+        {
+            const auto index2 = mapper()->loadValue(output, rhs);
+            output.append(equal ? Opcode::beq : Opcode::bne, reg(index1), reg(index2), label);
+        }
+        return;
+    }
+
+    if(isZero(rhs) and llvm::CmpInst::isSigned(kind))
+    {
+        const auto index1 = mapper()->loadValue(output, lhs);
+        switch(kind)
+        {
+            case llvm::CmpInst::ICMP_SLT: output.append(Opcode::bltz, reg(index1), label); break;
+            case llvm::CmpInst::ICMP_SLE: output.append(Opcode::blez, reg(index1), label); break;
+            case llvm::CmpInst::ICMP_SGT: output.append(Opcode::bgtz, reg(index1), label); break;
+            default: output.append(Opcode::bgez, reg(index1), label); break;
+        }
+        return;
+    }
+
+    // every other compare is a < b on swapped operands or with the branch inverted
+    const auto isSigned = llvm::CmpInst::isSigned(kind);
+    const auto opcode = isSigned ? Opcode::slt : Opcode::sltu;
+    const auto swapped = kind == llvm::CmpInst::ICMP_SGT or kind == llvm::CmpInst::ICMP_UGT or
+                         kind == llvm::CmpInst::ICMP_SLE or kind == llvm::CmpInst::ICMP_ULE;
+    const auto inverted = kind == llvm::CmpInst::ICMP_SGE or kind == llvm::CmpInst::ICMP_UGE or
+                          kind == llvm::CmpInst::ICMP_SLE or kind == llvm::CmpInst::ICMP_ULE;
+
+    // a > c is a >= c + 1 and a <= c is a < c + 1, so the constant stays on the right
+    if(const auto* constant = llvm::dyn_cast<llvm::ConstantInt>(rhs); constant != nullptr and constant->getBitWidth() <= 32)
+    {
+        auto value = immediate(constant);
+        if(not swapped or value != (isSigned ? std::numeric_limits<int32_t>::max() : -1))
+        {
+            value += swapped;
+            if(const auto form = immediateForm(opcode, value); form != opcode)
+            {
+                const auto index1 = mapper()->loadValue(output, lhs);
+                const auto temp = mapper()->getTempRegister(false);
+                output.append(form, reg(temp), reg(index1), imm(value));
+                output.append(inverted != swapped ? Opcode::beqz : Opcode::bnez, reg(temp), label);
+                return;
+            }
+        }
+    }
+
+    const auto index1 = mapper()->loadValue(output, lhs);
+    const auto index2 = mapper()->loadValue(output, rhs);
+    const auto temp = mapper()->getTempRegister(false);
+    output.append(opcode, reg(temp), reg(swapped ? index2 : index1), reg(swapped ? index1 : index2));
+    output.append(inverted ? Opcode::beqz : Opcode::bnez, reg(temp), label);
 }
 
-void Call::print(std::ostream& os)
+Call::Call(Block* block, llvm::Function* function, std::vector<llvm::Value*>&& arguments, llvm::Value* ret, bool tail)
+: Instruction(block), function(function), arguments(std::move(arguments)), ret(ret), tail(tail)
 {
-    const int other = module()->getFunctionSize(function);
-    auto iter = 4;
-
-    // store parameters
-    for(const auto& str : loads)
+    for(auto* arg : this->arguments)
     {
-        iter += 4;
-        output += str;
-        output += operation("sw", "$2", std::to_string(-other - iter) + "($sp)");
+        use(arg);
     }
+    if(not ret->getType()->isVoidTy() and not tail) define(ret);
+}
 
-    const auto incr = module()->isStdio(function) ? 4 : other + iter;
+void Call::emit(MachineBlock& output)
+{
+    // printf and scanf find their arguments below the stack pointer
+    if(module()->isStdio(function))
+    {
+        const int other = module()->getStdioSize(function);
+        for(size_t i = 0; i < arguments.size(); i++)
+        {
+            mapper()->placeInTempRegister(output, arguments[i], 2);
+            output.append(Opcode::sw, reg(2), address(-other - 4 - 4 * static_cast<int>(i), 29));
+        }
+        output.append(Opcode::jal, symbol(function));
+    }
+    else if(isSibling())
+    {
+        // first put the stack arguments below the stack, as they might still be read from our frame
+        const auto registers = argumentRegisters(function);
+        int staged = 0;
+        for(size_t i = 0; i < arguments.size(); i++)
+        {
+            if(registers[i] != -1) continue;
+            mapper()->placeInTempRegister(output, arguments[i], 2);
+            output.append(Opcode::sw, reg(2), address(-4 - 4 * staged++, 29));
+        }
+        mapper()->placeInRegisters(output, getRegisterArguments());
 
-    output += operation("sw", "$ra", "-4($sp)");
-    output += operation("addi", "$sp", "$sp", std::to_string(-incr));
-    output += operation("jal", label(function));
-    output += operation("addi", "$sp", "$sp", std::to_string(incr));
-    output += operation("lw", "$ra", "-4($sp)");
+        // then move them to the slots our caller left for us and jump, $ra still points to our caller
+        const auto frame = block->framed ? mapper()->getFrameSize() : 0;
+        for(int i = 0; i < staged; i++)
+        {
+            output.append(Opcode::lw, reg(2), address(-4 - 4 * i, 29));
+            output.append(Opcode::sw, reg(2), address(frame + 4 * i, 29));
+        }
+        if(block->framed) mapper()->loadSaved(output);
+        output.append(Opcode::j, symbol(function));
+        return;
+    }
+    else
+    {
+        // the arguments that do not fit in a register go to the bottom of our frame
+        const auto registers = argumentRegisters(function);
+        int stacked = 0;
+        for(size_t i = 0; i < arguments.size(); i++)
+        {
+            if(registers[i] != -1) continue;
+            mapper()->placeInTempRegister(output, arguments[i], 2);
+            output.append(Opcode::sw, reg(2), address(4 * stacked++, 29));
+        }
+        mapper()->placeInRegisters(output, getRegisterArguments());
+        output.append(Opcode::jal, symbol(function));
+    }
 
-    if(ret != nullptr)
+    if(tail)
+    {
+        // the return value is still in the return register
+        output.append(Opcode::j, branchTarget(block->function->getEpilogue(block->framed)));
+    }
+    else if(not ret->getType()->isVoidTy() and not ret->use_empty())
     {
         mapper()->loadReturnValue(output, ret);
     }
-    os << output;
 }
 
-Return::Return(Block* block, llvm::Value* value) : Instruction(block)
+RegisterMask Call::getClobbers() const
+{
+    auto clobbers = block->function->module->getClobbers(function);
+    for(const auto& [value, index] : getRegisterArguments()) clobbers.set(index);
+    return clobbers;
+}
+
+llvm::Function* Call::getCallee() const
+{
+    return function;
+}
+
+bool Call::isSibling() const
+{
+    // the stack arguments of the callee go where our caller left ours, so they have to fit
+    const auto stacked = [](llvm::Function* function) {
+        const auto registers = argumentRegisters(function);
+        return std::count(registers.begin(), registers.end(), -1);
+    };
+    const auto* module = block->function->module;
+    return tail and not module->isStdio(function) and stacked(function) <= stacked(block->function->getFunction());
+}
+
+int Call::getStackSize() const
+{
+    if(isSibling() or block->function->module->isStdio(function)) return 0;
+
+    const auto registers = argumentRegisters(function);
+    return 4 * static_cast<int>(std::count(registers.begin(), registers.end(), -1));
+}
+
+std::vector<std::pair<llvm::Value*, int>> Call::getRegisterArguments() const
+{
+    if(block->function->module->isStdio(function)) return {};
+
+    const auto registers = argumentRegisters(function);
+    std::vector<std::pair<llvm::Value*, int>> result;
+    for(size_t i = 0; i < arguments.size(); i++)
+    {
+        if(registers[i] != -1) result.emplace_back(arguments[i], registers[i]);
+    }
+    return result;
+}
+
+Return::Return(Block* block, llvm::Value* value) : Instruction(block), value(value)
+{
+    if(value != nullptr) use(value);
+}
+
+void Return::emit(MachineBlock& output)
 {
     if(value != nullptr)
     {
         mapper()->storeReturnValue(output, value);
     }
-    output += operation("j", label(block->function) + "end");
+    // a block that runs without the frame skips the restores
+    output.append(Opcode::j, branchTarget(block->function->getEpilogue(block->framed)));
+}
+
+Jump::Jump(Block* block, llvm::BasicBlock* target) : Instruction(block), target(target)
+{
 }
 
-Jump::Jump(Block* block, llvm::BasicBlock* target) : Instruction(block)
+void Jump::emit(MachineBlock& output)
 {
-    output += operation("j", label(target));
+    output.append(Opcode::j, branchTarget(block->function->getMachineBlock(target)));
 }
 
 Allocate::Allocate(Block* block, llvm::Value* t1, llvm::Type* type) : Instruction(block)
 {
-    mapper()->allocateValue(output, t1, type);
+    mapper()->allocateValue(t1, type);
 }
 
-Store::Store(Block* block, llvm::Value* t1, llvm::Value* t2) : Instruction(block)
+void Allocate::emit(MachineBlock& output)
+{
+}
+
+Store::Store(Block* block, llvm::Value* t1, llvm::Value* t2, int offset)
+: Instruction(block), t1(use(t1)), t2(use(t2)), offset(offset)
+{
+}
+
+void Store::emit(MachineBlock& output)
 {
     const auto index1 = mapper()->loadValue(output, t1);
-    const auto index2 = mapper()->loadValue(output, t2);
+    const auto pointer = mapper()->loadAddress(output, t2, offset);
 
     if(isFloat(t1))
     {
-        output += operation("s.s", reg(index1), '(' + reg(index2) + ')');
+        output.append(Opcode::s_s, reg(index1), pointer);
     }
     else
     {
         const auto isWord = module()->layout.getTypeStoreSize(t1->getType()) == 4;
-        output += operation(isWord ? "sw" : "sb", reg(index1), "(" + reg(index2) + ")");
+        output.append(isWord ? Opcode::sw : Opcode::sb, reg(index1), pointer);
     }
 }
 
@@ -497,13 +1370,23 @@ void Block::appendBeforeLast(Instruction* instruction)
     instructions.emplace(instructions.end() - 2, instruction);
 }
 
-void Block::print(std::ostream& os) const
+void Block::lower(MachineBlock& output) const
 {
-    os << label(block) << ":\n";
-    for(const auto& instruction : instructions)
+    auto* mapper = function->getMapper();
+    mapper->setLoopDepth(depth);
+    mapper->setFramed(framed);
+
+    if(mapper->getSavePoint() == this) mapper->saveFrame(output);
+
+    // the frame is freed after the copies into the phis of the successor, but before the jump to it
+    const auto jumps = not instructions.empty() and dynamic_cast<Jump*>(instructions.back().get()) != nullptr;
+    const auto last = instructions.end() - (restores and jumps ? 1 : 0);
+    for(auto iter = instructions.begin(); iter != instructions.end(); ++iter)
     {
-        instruction->print(os);
+        if(iter == last) mapper->loadSaved(output);
+        (*iter)->lower(output);
     }
+    if(restores and not jumps) mapper->loadSaved(output);
 }
 
 llvm::BasicBlock* Block::getBlock()
@@ -511,25 +1394,46 @@ llvm::BasicBlock* Block::getBlock()
     return block;
 }
 
+const std::vector<std::unique_ptr<Instruction>>& Block::getInstructions() const
+{
+    return instructions;
+}
+
 void Function::append(Block* block)
 {
     blocks.emplace_back(block);
 }
 
-void Function::print(std::ostream& os) const
+void Function::allocate(Allocator allocator)
 {
-    os << label(function) << ":\n";
-    mapper.print(os);
+    mapper.allocate(this, allocator);
+}
+
+void Function::lower()
+{
+    // every block exists before the first instruction is emitted, as a branch may go forward
+    auto* prologue = machine.appendBlock(label(function));
     for(const auto& block : blocks)
     {
-        block->print(os);
+        machineBlocks.emplace(block->getBlock(), machine.appendBlock(label(block->getBlock())));
     }
+    const auto name = "g" + std::to_string(reinterpret_cast<size_t>(this));
+    end = machine.appendBlock(name + "end");
+    leave = mapper.getSavePoint() != nullptr ? machine.appendBlock(name + "leave") : end;
 
-    std::string output;
-    output += label(this) + "end:\n";
-    mapper.loadSaved(output);
-    output += operation("jr", "$ra");
-    os << output;
+    mapper.prologue(*prologue);
+    for(const auto& block : blocks)
+    {
+        block->lower(*machineBlocks.at(block->getBlock()));
+    }
+    mapper.loadSaved(*end);
+    leave->append(Opcode::jr, reg(31));
+    machine.link();
+}
+
+void Function::print(std::ostream& os) const
+{
+    machine.print(os);
 }
 
 bool Function::isMain() const
@@ -555,6 +1459,26 @@ Block* Function::getBlockByBasicBlock(llvm::BasicBlock* block)
     return (iter == blocks.end()) ? nullptr : iter->get();
 }
 
+const std::vector<std::unique_ptr<Block>>& Function::getBlocks() const
+{
+    return blocks;
+}
+
+MachineFunction& Function::getMachineFunction()
+{
+    return machine;
+}
+
+MachineBlock* Function::getMachineBlock(llvm::BasicBlock* block) const
+{
+    return machineBlocks.at(block);
+}
+
+MachineBlock* Function::getEpilogue(bool framed) const
+{
+    return framed ? end : leave;
+}
+
 void Module::append(Function* function)
 {
     if(function->isMain())
@@ -564,6 +1488,45 @@ void Module::append(Function* function)
     functions.emplace_back(function);
 }
 
+void Module::allocate(Allocator allocator)
+{
+    std::map<llvm::Function*, Function*> lookup;
+    for(const auto& function : functions)
+    {
+        lookup.emplace(function->getFunction(), function.get());
+    }
+
+    // a depth first walk over the calls allocates in post order, a callee that is still on the path is recursive
+    std::set<Function*> visited;
+    const auto visit = [&](const auto& self, Function* function) -> void {
+        if(not visited.insert(function).second) return;
+        for(const auto& block : function->getBlocks())
+        {
+            for(const auto& instruction : block->getInstructions())
+            {
+                const auto* call = dynamic_cast<const Call*>(instruction.get());
+                if(call == nullptr) continue;
+                if(const auto iter = lookup.find(call->getCallee()); iter != lookup.end()) self(self, iter->second);
+            }
+        }
+        function->allocate(allocator);
+        clobbers.emplace(function->getFunction(), function->getMapper()->getClobbers());
+    };
+    for(const auto& function : functions)
+    {
+        visit(visit, function.get());
+    }
+}
+
+void Module::lower()
+{
+    for(const auto& function : functions)
+    {
+        function->lower();
+        peephole.run(function->getMachineFunction());
+    }
+}
+
 void Module::print(std::ostream& os) const
 {
     os << ".data\n";
@@ -635,7 +1598,6 @@ void Module::print(std::ostream& os) const
     os << "$begin:\n";
     if(main)
     {
-        os << "addi $sp, $sp, " << -main->getMapper()->getSaveSize() << '\n';
         os << "jal main\n";
         os << "move $4, $2\n";
     }
@@ -646,9 +1608,10 @@ void Module::print(std::ostream& os) const
     os << "li $2, 17\n";
     os << "syscall\n";
 
-    if(printfIncluded)
+    const auto isCalled = [](llvm::Function* function) { return function and not function->use_empty(); };
+    if(isCalled(printf) or isCalled(scanf))
     {
-        os << getStdioImpl();
+        os << getStdioImpl(isCalled(printf), isCalled(scanf));
     }
 
     for(const auto& function : functions)
@@ -657,6 +1620,21 @@ void Module::print(std::ostream& os) const
     }
 }
 
+SpillStatistics Module::getStatistics() const
+{
+    SpillStatistics statistics;
+    for(const auto& function : functions)
+    {
+        statistics += function->getMapper()->getStatistics();
+    }
+    return statistics;
+}
+
+std::vector<std::pair<std::string, size_t>> Module::getPeepholeHits() const
+{
+    return peephole.getHits();
+}
+
 void Module::addGlobal(llvm::GlobalVariable* variable)
 {
     if(variable->getValueType()->isFloatTy())
@@ -675,7 +1653,7 @@ void Module::addFloat(llvm::ConstantFP* variable)
     floats.emplace(variable);
 }
 
-int Module::getFunctionSize(llvm::Function* function)
+int Module::getStdioSize(llvm::Function* function) const
 {
     if(function == printf)
     {
@@ -685,14 +1663,16 @@ int Module::getFunctionSize(llvm::Function* function)
     {
         return 20;
     }
+    throw InternalError("only printf and scanf take their arguments below the stack pointer");
+}
 
-    const auto pred = [&](const auto& ptr) { return ptr->getFunction() == function; };
-    const auto iter = std::find_if(functions.begin(), functions.end(), pred);
-    if(iter == functions.end())
-    {
-        throw CompilationError("could not find given function: " + function->getName().str());
-    }
-    return (*iter)->getMapper()->getSaveSize();
+RegisterMask Module::getClobbers(llvm::Function* function) const
+{
+    // printf and scanf restore every register they use
+    if(isStdio(function)) return {};
+
+    const auto iter = clobbers.find(function);
+    return iter == clobbers.end() ? RegisterMask().set() : iter->second;
 }
 
 bool Module::isStdio(llvm::Function* function) const
@@ -702,19 +1682,19 @@ bool Module::isStdio(llvm::Function* function) const
 
 void Module::includeStdio(llvm::Function* printf, llvm::Function* scanf)
 {
-    printfIncluded = true;
     this->printf = printf;
     this->scanf = scanf;
 }
 
-const char* Module::getStdioImpl() const
+std::string Module::getStdioImpl(bool withPrintf, bool withScanf)
 {
-    return "\n"
+    const auto* header = "\n"
            "###############\n"
            "#  stdio.asm  #\n"
            "###############\n"
-           "\n"
-           "printf:\n"
+           "\n";
+
+    const auto* printfImpl = "printf:\n"
            "\taddu $sp, $sp, -16\t#buffer for char (4) and \\0 (8)\n"
            "\tsw $t0, 0($sp)\n"
            "\tsw $t1, 4($sp)\n"
@@ -789,8 +1769,9 @@ const char* Module::getStdioImpl() const
            "\tli $v0, 0\n"
            "\tjr $ra\n"
            "\n"
-           "\n"
-           "scanf:\n"
+           "\n";
+
+    const auto* scanfImpl = "scanf:\n"
            "\taddu $sp, $sp, -20\n"
            "\tsw $t0, 0($sp)\n"
            "\tsw $t1, 4($sp)\n"
@@ -867,18 +1848,25 @@ const char* Module::getStdioImpl() const
            "\tj scanf_shift\n"
            "\n"
            "scanf_end:\n"
-           "\tswc1 $f0, 16($sp)\n"
-           "\tsw $a1, 12($sp)\n"
-           "\tsw $a0, 8($sp)\n"
-           "\tsw $t1, 4($sp)\n"
-           "\tsw $t0, 0($sp)\n"
+           "\tlwc1 $f0, 16($sp)\n"
+           "\tlw $a1, 12($sp)\n"
+           "\tlw $a0, 8($sp)\n"
+           "\tlw $t1, 4($sp)\n"
+           "\tlw $t0, 0($sp)\n"
            "\taddu $sp, $sp, 20\n"
            "\tli $v0, 0\n"
            "\tjr $ra\n"
-           "\n"
-           "###############\n"
+           "\n";
+
+    const auto* footer = "###############\n"
            "#  stdio.asm  #\n"
            "###############\n";
+
+    // only the routines that are actually called end up in the assembly
+    std::string result = header;
+    if(withPrintf) result += printfImpl;
+    if(withScanf) result += scanfImpl;
+    return result + footer;
 }
 
 
@@ -9,7 +9,11 @@
 #include <iostream>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
+#include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Value.h>
+#include "machine.h"
+#include "peephole.h"
+#include "regalloc.h"
 
 #include <map>
 #include <numeric>
@@ -18,6 +22,12 @@
 #include <string>
 #include <vector>
 
+namespace llvm
+{
+class DominatorTree;
+class LoopInfo;
+} // namespace llvm
+
 namespace mips
 {
 
@@ -25,51 +35,103 @@ class Block;
 class Function;
 class Module;
 
+// the register every parameter of a function is passed in, or -1 for the ones that are passed at the bottom of the
+// frame of the caller: the integer parameters go in $a0-$a3 and the float parameters in $f12 and $f14, like o32 but
+// counted apart
+std::vector<int> argumentRegisters(llvm::Function* function);
+
 class RegisterMapper
 {
     public:
     explicit RegisterMapper(Module* module, llvm::Function* function);
 
-    int loadValue(std::string& output, llvm::Value* id);
-    void loadSaved(std::string& output) const;
+    // allocates the registers once every instruction of the function is known, then lays out the frame
+    void allocate(Function* owner, Allocator allocator);
+
+    // the register that holds the value, constants and spilled values are first put in a temp register, an integer
+    // zero is read from $zero
+    int loadValue(MachineBlock& output, llvm::Value* id);
+    // the address of a load or store at an offset from the pointer, an alloca is addressed from $sp and a global by
+    // its label
+    Operand loadAddress(MachineBlock& output, llvm::Value* pointer, int offset);
+    // the register an instruction writes the value to, storeValue writes a spilled value back afterwards
+    int defineValue(llvm::Value* id);
+    void storeValue(MachineBlock& output, llvm::Value* id);
 
-    bool placeConstant(std::string& output, int index, llvm::Value* id);
-    void placeInTempRegister(std::string& output, llvm::Value* id, int index);
+    // allocates the frame and saves the registers, in the prologue or at the start of the save point
+    void saveFrame(MachineBlock& output) const;
+    // restores the saved registers and $ra and frees the frame, for the epilogue and sibling calls
+    void loadSaved(MachineBlock& output) const;
 
+    // puts the values in the given registers as if it happens at once, as they may be in each other's register
+    void placeInRegisters(MachineBlock& output, const std::vector<std::pair<llvm::Value*, int>>& values);
+
+    bool placeConstant(MachineBlock& output, int index, llvm::Value* id);
+    void placeInTempRegister(MachineBlock& output, llvm::Value* id, int index);
+
+    // the temp registers are only valid during one instruction
     int getTempRegister(bool fl);
-    int getNextSpill(bool fl);
+    void releaseTempRegisters();
 
-    void loadReturnValue(std::string& output, llvm::Value* id);
-    void storeReturnValue(std::string& output, llvm::Value* id);
+    void loadReturnValue(MachineBlock& output, llvm::Value* id);
+    void storeReturnValue(MachineBlock& output, llvm::Value* id);
 
-    void allocateValue(std::string& output, llvm::Value* id, llvm::Type* type);
-//    void addToMap(llvm::Value* from, llvm::Value* to);
+    void allocateValue(llvm::Value* id, llvm::Type* type);
 
-    [[nodiscard]] int getSaveSize() const noexcept;
-    [[nodiscard]] int getArgsSize() const noexcept;
+    void setLoopDepth(unsigned depth);
+    void setFramed(bool framed);
 
-    void print(std::ostream& os) const;
+    [[nodiscard]] int getFrameSize() const noexcept;
+    [[nodiscard]] const RegisterMask& getClobbers() const noexcept;
+    [[nodiscard]] Block* getSavePoint() const noexcept;
+    [[nodiscard]] const SpillStatistics& getStatistics() const noexcept;
+
+    // the prologue: allocates the frame, saves the registers and puts the arguments in their place
+    void prologue(MachineBlock& output);
 
     private:
-    std::string stores;
+    // moves the frame setup to the block that dominates every block which needs the frame, see Block::framed
+    void shrinkWrap(Function* owner, llvm::DominatorTree& tree, const llvm::LoopInfo& loops);
+
+    // the register that holds the value in the current block, or -1
+    [[nodiscard]] int findRegister(llvm::Value* id) const;
+
     Module* module;
     llvm::Function* function;
 
-    std::array<std::vector<int>, 2> emptyRegisters;
-    std::array<std::vector<int>, 2> savedRegisters;
-    std::array<std::vector<llvm::Value*>, 2> registerValues;
-
+    // the registers of every value, values without a register are spilled to their address
     std::array<std::map<llvm::Value*, int>, 2> registerDescriptors;
     std::array<std::map<llvm::Value*, int>, 2> addressDescriptors;
-    std::array<std::map<llvm::Value*, int>, 2> pointerDescriptors;
+    std::map<llvm::Value*, int> pointerDescriptors;
+
+    std::vector<std::pair<llvm::Value*, int>> allocas;
+    std::vector<std::pair<int, int>> savedRegisters;
+
+    // the values that were put in a temp register by the current instruction
+    std::map<llvm::Value*, int> temps;
+    std::array<size_t, 2> used = {0, 0};
+
+    std::array<int, 2> start = {4, 3};
+    std::array<int, 2> end = {24, 32};
+    // the registers from $s0 and $f20 on keep their value over a call, the callee saves the ones it uses
+    std::array<int, 2> calleeSaved = {16, 20};
+    std::array<std::vector<int>, 2> tempRegisters = {std::vector<int>{2, 3, 24, 25}, std::vector<int>{0, 1, 2}};
 
-    std::array<int, 2> start = {4, 2};
-    std::array<int, 2> end = {26, 32};
-    std::array<int, 2> spill = {start[0], start[1]};
-    std::array<int, 2> temp = {0, 0};
+    // the frame is allocated once in the prologue, a leaf function without spills or allocas has none
+    int frameSize = 0;
 
-    int saveSize = 0;
-    int argsSize = 0;
+    // the caller saved registers the function overwrites, also through its calls
+    RegisterMask clobbers;
+
+    // the block that allocates the frame when the function is shrink-wrapped, otherwise the prologue does
+    Block* savePoint = nullptr;
+
+    // the arguments in a callee saved register stay in the register they came in until the save point
+    std::map<llvm::Value*, int> entryRegisters;
+    bool framed = true;
+
+    unsigned depth = 0;
+    SpillStatistics statistics;
 };
 
 class Instruction
@@ -79,90 +141,265 @@ class Instruction
     {
     }
 
-    virtual void print(std::ostream& os);
+    virtual ~Instruction() = default;
+
+    // the machine instructions are only generated after register allocation
+    void lower(MachineBlock& output);
+
+    [[nodiscard]] const std::vector<llvm::Value*>& getUses() const noexcept;
+    [[nodiscard]] const std::vector<llvm::Value*>& getDefs() const noexcept;
+
+    // the destination is written before every operand is read, so it can not share a register with them
+    [[nodiscard]] virtual bool isEarlyClobber() const;
+
+    // the registers the instruction overwrites besides its definitions and the temp registers
+    [[nodiscard]] virtual RegisterMask getClobbers() const;
 
     RegisterMapper* mapper();
     Module* module();
 
     protected:
+    virtual void emit(MachineBlock& output) = 0;
+
+    // the operands are remembered for the liveness analysis
+    llvm::Value* use(llvm::Value* value);
+    llvm::Value* define(llvm::Value* value);
+
     Block* block;
-    std::string output;
+
+    private:
+    std::vector<llvm::Value*> uses;
+    std::vector<llvm::Value*> defs;
 };
 
 // move
 struct Move : public Instruction
 {
     Move(Block* block, llvm::Value* t1, llvm::Value* t2);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
 };
 
 struct Convert : public Instruction
 {
     Convert(Block* block, llvm::Value* t1, llvm::Value* t2);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
 };
 
-// lw, li, lb, l.s
+// lw, lb, lwc1 from t2 + offset
 struct Load : public Instruction
 {
-    Load(Block* block, llvm::Value* t1, llvm::Value* t2);
+    Load(Block* block, llvm::Value* t1, llvm::Value* t2, int offset = 0);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
+    int offset;
 };
 
-// add, sub, mul
+// add, sub, mul, or addiu, andi, slti... when the second operand is a constant that fits in 16 bits
 struct Arithmetic : public Instruction
 {
-    Arithmetic(Block* block, std::string type, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3);
+    Arithmetic(Block* block, Opcode opcode, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    Opcode opcode;
+    llvm::Value* t1;
+    llvm::Value* t2;
+    llvm::Value* t3;
 };
 
 // modulo
 struct Modulo : public Instruction
 {
-    Modulo(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3);
+    Modulo(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3, bool isSigned);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
+    llvm::Value* t3;
+    bool isSigned;
+};
+
+// multiplication by a constant: sll, addu, subu
+struct Multiply : public Instruction
+{
+    Multiply(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::ConstantInt* constant);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
+    llvm::ConstantInt* constant;
+};
+
+// division and modulo by a constant: sra, srl, andi or a magic number multiplication
+struct Divide : public Instruction
+{
+    Divide(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::ConstantInt* constant, bool isSigned, bool isModulo);
+
+    void emit(MachineBlock& output) override;
+    [[nodiscard]] bool isEarlyClobber() const override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
+    llvm::ConstantInt* constant;
+    bool isSigned;
+    bool isModulo;
+};
+
+// address calculation t1 = t2 + t3 * size
+struct Offset : public Instruction
+{
+    Offset(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3, uint64_t size);
+
+    void emit(MachineBlock& output) override;
+    [[nodiscard]] bool isEarlyClobber() const override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
+    llvm::Value* t3;
+    uint64_t size;
 };
 
 struct NotEquals : public Instruction
 {
     NotEquals(Block* block, llvm::Value* t1, llvm::Value* t2, llvm::Value* t3);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
+    llvm::Value* t3;
+};
+
+// movn
+struct Select : public Instruction
+{
+    Select(Block* block, llvm::Value* t1, llvm::Value* condition, llvm::Value* t2, llvm::Value* t3);
+
+    void emit(MachineBlock& output) override;
+    [[nodiscard]] bool isEarlyClobber() const override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* condition;
+    llvm::Value* t2;
+    llvm::Value* t3;
 };
 
 struct Branch : public Instruction
 {
     explicit Branch(Block* block, llvm::Value* t1, llvm::BasicBlock* target, bool eqZero);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* t1;
+    llvm::BasicBlock* target;
+    bool eqZero;
+};
+
+// beq, bne, bltz, blez, bgtz, bgez, or slt and a branch on its result, for a compare that only the branch uses
+struct CompareBranch : public Instruction
+{
+    explicit CompareBranch(Block* block, llvm::CmpInst::Predicate predicate, llvm::Value* t1, llvm::Value* t2, llvm::BasicBlock* target);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::CmpInst::Predicate predicate;
+    llvm::Value* t1;
+    llvm::Value* t2;
+    llvm::BasicBlock* target;
 };
 
-// jal
+// jal, or j for sibling calls
 struct Call : public Instruction
 {
-    explicit Call(Block* block, llvm::Function* function, std::vector<llvm::Value*>&& arguments, llvm::Value* ret);
+    explicit Call(Block* block, llvm::Function* function, std::vector<llvm::Value*>&& arguments, llvm::Value* ret, bool tail = false);
 
-    void print(std::ostream& os) override;
+    void emit(MachineBlock& output) override;
+
+    // the registers the callee overwrites and the argument registers
+    [[nodiscard]] RegisterMask getClobbers() const override;
+
+    [[nodiscard]] llvm::Function* getCallee() const;
+
+    // the arguments that are passed in a register, with that register
+    [[nodiscard]] std::vector<std::pair<llvm::Value*, int>> getRegisterArguments() const;
+
+    // a sibling call leaves with j, so it does not overwrite $ra and needs no space in our frame
+    [[nodiscard]] bool isSibling() const;
+
+    // the bytes at the bottom of our frame where the callee finds the arguments that are not in a register
+    [[nodiscard]] int getStackSize() const;
 
     private:
     llvm::Function* function;
     std::vector<llvm::Value*> arguments;
     llvm::Value* ret;
-
-    std::vector<std::string> loads;
+    bool tail;
 };
 
 struct Return : public Instruction
 {
     explicit Return(Block* block, llvm::Value* value);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* value;
 };
 
 // j
 struct Jump : public Instruction
 {
     explicit Jump(Block* block, llvm::BasicBlock* target);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::BasicBlock* target;
 };
 
 struct Allocate : public Instruction
 {
     Allocate(Block* block, llvm::Value* t1, llvm::Type* type);
+
+    void emit(MachineBlock& output) override;
 };
 
-// sw, sb
+// sw, sb, s.s to t2 + offset
 struct Store : public Instruction
 {
-    explicit Store(Block* block, llvm::Value* t1, llvm::Value* t2);
+    explicit Store(Block* block, llvm::Value* t1, llvm::Value* t2, int offset = 0);
+
+    void emit(MachineBlock& output) override;
+
+    private:
+    llvm::Value* t1;
+    llvm::Value* t2;
+    int offset;
 };
 
 class Block
@@ -178,11 +415,22 @@ class Block
 
     void appendBeforeLast(Instruction* instruction);
 
-    void print(std::ostream& os) const;
+    void lower(MachineBlock& output) const;
 
     llvm::BasicBlock* getBlock();
 
+    [[nodiscard]] const std::vector<std::unique_ptr<Instruction>>& getInstructions() const;
+
     Function* function;
+
+    // the loop nesting depth, which weighs the uses in the block for the register allocator
+    unsigned depth = 0;
+
+    // whether the frame is allocated while the block runs, and whether the block frees it before it jumps to a
+    // successor that runs without
+    bool framed = true;
+    bool restores = false;
+
     private:
     llvm::BasicBlock* block;
     std::vector<std::unique_ptr<Instruction>> instructions;
@@ -199,6 +447,11 @@ class Function
 
     void append(Block* block);
 
+    void allocate(Allocator allocator);
+
+    // emits the machine instructions of the prologue, every block and the epilogue
+    void lower();
+
     void print(std::ostream& os) const;
 
     [[nodiscard]] bool isMain() const;
@@ -209,12 +462,26 @@ class Function
 
     Block* getBlockByBasicBlock(llvm::BasicBlock* block);
 
+    [[nodiscard]] MachineBlock* getMachineBlock(llvm::BasicBlock* block) const;
+
+    // the epilogue frees the frame before it returns, a block that runs without the frame jumps past that
+    [[nodiscard]] MachineBlock* getEpilogue(bool framed) const;
+
+    [[nodiscard]] const std::vector<std::unique_ptr<Block>>& getBlocks() const;
+
+    MachineFunction& getMachineFunction();
+
     Module* module;
     private:
     llvm::Function* function;
     std::vector<std::unique_ptr<Block>> blocks;
 
     RegisterMapper mapper;
+
+    MachineFunction machine;
+    std::map<llvm::BasicBlock*, MachineBlock*> machineBlocks;
+    MachineBlock* end = nullptr;
+    MachineBlock* leave = nullptr;
 };
 
 class Module
@@ -226,31 +493,48 @@ class Module
 
     void append(Function* function);
 
+    // the callees are allocated before their callers, so a call only clobbers the registers its callee uses
+    void allocate(Allocator allocator);
+
+    // lowers every function to machine instructions and runs the peephole optimizer over them
+    void lower();
+
     void print(std::ostream& os) const;
 
+    [[nodiscard]] SpillStatistics getStatistics() const;
+
+    [[nodiscard]] std::vector<std::pair<std::string, size_t>> getPeepholeHits() const;
+
+    // every caller saved register for a function that is not allocated yet, as in a cycle of recursive calls
+    [[nodiscard]] RegisterMask getClobbers(llvm::Function* function) const;
+
     void addGlobal(llvm::GlobalVariable* variable);
 
     void addFloat(llvm::ConstantFP* variable);
 
-    int getFunctionSize(llvm::Function* function);
+    // the bytes printf and scanf use below the stack pointer, their arguments are stored right below those
+    int getStdioSize(llvm::Function* function) const;
 
     bool isStdio(llvm::Function* function) const;
 
     void includeStdio(llvm::Function* printf, llvm::Function* scanf);
 
-    const char* getStdioImpl() const;
+    // the printf and scanf routines of asm/stdio.asm, they take their arguments below the stack pointer
+    static std::string getStdioImpl(bool withPrintf, bool withScanf);
 
     llvm::DataLayout layout;
     Function* main = nullptr;
 
-    bool printfIncluded = false;
-    llvm::Function* printf;
-    llvm::Function* scanf;
+    llvm::Function* printf = nullptr;
+    llvm::Function* scanf = nullptr;
 
     private:
     std::vector<std::unique_ptr<Function>> functions;
+    std::map<llvm::Function*, RegisterMask> clobbers;
     std::set<llvm::GlobalVariable*> globals;
     std::set<llvm::ConstantFP*> floats;
+
+    Peephole peephole;
 };
 
 
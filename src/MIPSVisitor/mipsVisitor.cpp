@@ -14,12 +14,14 @@
 using namespace llvm;
 using namespace mips;
 
-MIPSVisitor::MIPSVisitor(const llvm::Module& module)
-		:module(module.getDataLayout()) { }
+MIPSVisitor::MIPSVisitor(const llvm::Module& module, mips::Allocator allocator)
+		:module(module.getDataLayout()), allocator(allocator) { }
 
 void MIPSVisitor::convertIR(llvm::Module& module)
 {
 	visit(module);
+	this->module.allocate(allocator);
+	this->module.lower();
 }
 
 void MIPSVisitor::print(const std::filesystem::path& output)
@@ -29,6 +31,16 @@ void MIPSVisitor::print(const std::filesystem::path& output)
 	stream.close();
 }
 
+mips::SpillStatistics MIPSVisitor::getStatistics() const
+{
+	return module.getStatistics();
+}
+
+std::vector<std::pair<std::string, size_t>> MIPSVisitor::getPeepholeHits() const
+{
+	return module.getPeepholeHits();
+}
+
 void MIPSVisitor::visitModule(llvm::Module& M)
 {
 	if (M.getFunction("printf") || M.getFunction("scanf"))
@@ -63,6 +75,9 @@ void MIPSVisitor::visitBasicBlock(BasicBlock& BB)
 
 void MIPSVisitor::visitCmpInst(CmpInst& I)
 {
+	// the branch compares the operands itself
+	if (const auto* compare = dyn_cast<ICmpInst>(&I); compare && isFusable(*compare)) return;
+
 	const auto& a = &I;
 	const auto& b = processOperand(I.getOperand(0));
 	const auto& c = processOperand(I.getOperand(1));
@@ -70,57 +85,57 @@ void MIPSVisitor::visitCmpInst(CmpInst& I)
 	switch (I.getPredicate()) {
 	case CmpInst::FCMP_OEQ:
 	case CmpInst::FCMP_UEQ:
-		instruction = new mips::Arithmetic(currentBlock, "c.eq.s", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::c_eq_s, a, b, c);
 		break;
 	case CmpInst::FCMP_OGT:
 	case CmpInst::FCMP_UGT:
-		instruction = new mips::Arithmetic(currentBlock, "c.lt.s", a, c, b);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::c_lt_s, a, c, b);
 		break;
 	case CmpInst::FCMP_OGE:
 	case CmpInst::FCMP_UGE:
-		instruction = new mips::Arithmetic(currentBlock, "c.le.s", a, c, b);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::c_le_s, a, c, b);
 		break;
 	case CmpInst::FCMP_OLT:
 	case CmpInst::FCMP_ULT:
-		instruction = new mips::Arithmetic(currentBlock, "c.lt.s", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::c_lt_s, a, b, c);
 		break;
 	case CmpInst::FCMP_OLE:
 	case CmpInst::FCMP_ULE:
-		instruction = new mips::Arithmetic(currentBlock, "c.le.s", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::c_le_s, a, b, c);
 		break;
 	case CmpInst::FCMP_ONE:
 	case CmpInst::FCMP_UNE:
 		instruction = new mips::NotEquals(currentBlock, a, b, c);
 		break;
 	case CmpInst::ICMP_EQ:
-		instruction = new mips::Arithmetic(currentBlock, "seq", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::seq, a, b, c);
 		break;
 	case CmpInst::ICMP_NE:
-		instruction = new mips::Arithmetic(currentBlock, "sne", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sne, a, b, c);
 		break;
 	case CmpInst::ICMP_UGT:
-		instruction = new mips::Arithmetic(currentBlock, "sgtu", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sgtu, a, b, c);
 		break;
 	case CmpInst::ICMP_UGE:
-		instruction = new mips::Arithmetic(currentBlock, "sgeu", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sgeu, a, b, c);
 		break;
 	case CmpInst::ICMP_ULT:
-		instruction = new mips::Arithmetic(currentBlock, "sleu", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sltu, a, b, c);
 		break;
 	case CmpInst::ICMP_ULE:
-		instruction = new mips::Arithmetic(currentBlock, "slue", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sleu, a, b, c);
 		break;
 	case CmpInst::ICMP_SGT:
-		instruction = new mips::Arithmetic(currentBlock, "sgt", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sgt, a, b, c);
 		break;
 	case CmpInst::ICMP_SGE:
-		instruction = new mips::Arithmetic(currentBlock, "sge", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sge, a, b, c);
 		break;
 	case CmpInst::ICMP_SLT:
-		instruction = new mips::Arithmetic(currentBlock, "slt", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::slt, a, b, c);
 		break;
 	case CmpInst::ICMP_SLE:
-		instruction = new mips::Arithmetic(currentBlock, "sle", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sle, a, b, c);
 		break;
 	default:
 		instruction = nullptr;
@@ -132,7 +147,8 @@ void MIPSVisitor::visitCmpInst(CmpInst& I)
 
 void MIPSVisitor::visitLoadInst(LoadInst& I)
 {
-	currentBlock->append(new mips::Load(currentBlock, &I, processOperand(I.getPointerOperand())));
+	const auto [pointer, offset] = foldAddress(I.getPointerOperand());
+	currentBlock->append(new mips::Load(currentBlock, &I, pointer, offset));
 }
 
 void MIPSVisitor::visitAllocaInst(AllocaInst& I)
@@ -142,22 +158,27 @@ void MIPSVisitor::visitAllocaInst(AllocaInst& I)
 
 void MIPSVisitor::visitStoreInst(StoreInst& I)
 {
-	currentBlock->append(
-			new mips::Store(currentBlock, processOperand(I.getValueOperand()), processOperand(I.getPointerOperand())));
+	const auto [pointer, offset] = foldAddress(I.getPointerOperand());
+	currentBlock->append(new mips::Store(currentBlock, processOperand(I.getValueOperand()), pointer, offset));
 }
 
 void MIPSVisitor::visitGetElementPtrInst(GetElementPtrInst& I)
 {
+	// the loads and stores put the offset in their address themselves
+	if (isFoldable(cast<GEPOperator>(&I))) return;
+
 	const auto& base = processOperand(I.getPointerOperand());
 	APInt a(32, 0);
 	if (I.hasAllZeroIndices()) {
 		currentBlock->append(new mips::Move(currentBlock, &I, base));
 	}
 	else if (I.accumulateConstantOffset(module.layout, a)) {
-		currentBlock->append(new mips::Arithmetic(currentBlock, "addu", &I, base,
+		currentBlock->append(new mips::Arithmetic(currentBlock, Opcode::addu, &I, base,
 				Constant::getIntegerValue(IntegerType::getInt32Ty(I.getContext()), a)));
 	}
 	else {
+		// accumulate the offset of every index into the result, starting from the base
+		llvm::Value* current = base;
 		llvm::Type* currentType = I.getPointerOperandType();
 		for (const auto& index: I.indices()) {
 			const auto i = processOperand(index);
@@ -165,31 +186,20 @@ void MIPSVisitor::visitGetElementPtrInst(GetElementPtrInst& I)
 			const auto size = module.layout.getTypeAllocSize(currentType);
 			if (const auto& constant = dyn_cast<ConstantInt>(i)) {
 				if (not constant->getZExtValue()) continue;
-				currentBlock->append(new mips::Arithmetic(currentBlock, "addu", &I, base,
+				currentBlock->append(new mips::Arithmetic(currentBlock, Opcode::addu, &I, current,
 						ConstantInt::get(IntegerType::getInt32Ty(I.getContext()), size*constant->getZExtValue())));
-				continue;
 			}
-			const auto& mul = BinaryOperator::Create(llvm::Instruction::Mul, i,
-					ConstantInt::get(IntegerType::getInt32Ty(I.getContext()), size));
-			currentBlock->append(
-					new mips::Arithmetic(currentBlock, "mulu", mul, processOperand(mul->getOperand(0)),
-							processOperand(mul->getOperand(1))));
-			currentBlock->append(new mips::Arithmetic(currentBlock, "addu", &I, base, mul));
+			else {
+				currentBlock->append(new mips::Offset(currentBlock, &I, current, i, size));
+			}
+			current = &I;
 		}
 	}
 }
 
 void MIPSVisitor::visitPHINode(PHINode& I)
-{//
-//	const auto backup = currentBlock;
-//	for (const auto& block: I.blocks()) {
-//		const auto& mipsBlock = currentFunction->getBlockByBasicBlock(block);
-//		currentBlock = mipsBlock;
-//		const auto& value = processOperand(I.getIncomingValueForBlock(block));
-//		mipsBlock->appendBeforeLast(new mips::Move(currentBlock, &I, value));
-//	}
-//	currentBlock = backup;
-	InstVisitor::visitPHINode(I);
+{
+	// the value is copied into the phi at the end of every predecessor, see copyPhiValues
 }
 
 void MIPSVisitor::visitTruncInst(TruncInst& I)
@@ -256,47 +266,95 @@ void MIPSVisitor::visitBitCastInst(BitCastInst& I)
 	currentBlock->append(new mips::Move(currentBlock, &I, I.getOperand(0)));
 }
 
+void MIPSVisitor::visitSelectInst(SelectInst& I)
+{
+	currentBlock->append(new mips::Select(currentBlock, &I, processOperand(I.getCondition()),
+			processOperand(I.getTrueValue()), processOperand(I.getFalseValue())));
+}
+
 void MIPSVisitor::visitCallInst(CallInst& I)
 {
 	std::vector<Value*> args;
 	for (const auto& arg: I.args()) {
 		args.emplace_back(processOperand(arg));
 	}
-	currentBlock->append(new mips::Call(currentBlock, I.getCalledFunction(), std::move(args), &I));
+	currentBlock->append(new mips::Call(currentBlock, I.getCalledFunction(), std::move(args), &I, isSiblingCall(I)));
 }
 
 void MIPSVisitor::visitReturnInst(ReturnInst& I)
 {
+	// the sibling call before this already returns for us
+	if (const auto* call = dyn_cast_or_null<CallInst>(I.getPrevNode()); call && isSiblingCall(*call)) return;
+
 	currentBlock->append(
 			new mips::Return(currentBlock,
 					(isa_and_nonnull<UndefValue>(I.getReturnValue())) ? nullptr : processOperand(I.getReturnValue())));
 }
 
+bool MIPSVisitor::isFusable(const ICmpInst& I) const
+{
+	if (!I.hasOneUse()) return false;
+	const auto* branch = dyn_cast<BranchInst>(*I.user_begin());
+	if (branch==nullptr || branch->getParent()!=I.getParent()) return false;
+
+	// the phi copies come before the branch, so it can not read a phi they overwrite
+	return none_of(I.operands(), [&](const auto& operand) {
+		const auto* phi = dyn_cast<PHINode>(operand.get());
+		return phi && is_contained(branch->successors(), phi->getParent());
+	});
+}
+
+bool MIPSVisitor::isSiblingCall(const CallInst& I) const
+{
+	// calls marked tail by the optimizer whose result is returned directly can reuse our frame,
+	// the stdio functions have their own calling convention
+	auto* function = I.getCalledFunction();
+	if (!I.isTailCall() || function==nullptr || module.isStdio(function)) return false;
+
+	const auto* ret = dyn_cast_or_null<ReturnInst>(I.getNextNode());
+	if (ret==nullptr) return false;
+	return ret->getReturnValue()==nullptr || ret->getReturnValue()==&I;
+}
+
 void MIPSVisitor::visitBranchInst(BranchInst& I)
 {
+	copyPhiValues(I);
 	if (I.isConditional()) {
+		// branches to the target when the condition has the given value
+		const auto branch = [&](BasicBlock* target, bool condition) {
+			const auto* compare = dyn_cast<ICmpInst>(I.getCondition());
+			if (compare && isFusable(*compare)) {
+				const auto predicate = condition ? compare->getPredicate() : compare->getInversePredicate();
+				currentBlock->append(new mips::CompareBranch(currentBlock, predicate,
+						processOperand(compare->getOperand(0)), processOperand(compare->getOperand(1)), target));
+			}
+			else {
+				currentBlock->append(new mips::Branch(currentBlock, processOperand(I.getCondition()), target,
+						!condition));
+			}
+		};
+
 		bool first = currentBlock->getBlock()->getNextNode()==I.getSuccessor(0);
 		bool second = currentBlock->getBlock()->getNextNode()==I.getSuccessor(1);
 		if (first && !second)
-			currentBlock->append(
-					new mips::Branch(currentBlock, processOperand(I.getCondition()), I.getSuccessor(1),
-							true));   // bneqz
+			branch(I.getSuccessor(1), false);
 		else if (!first && second)
-			currentBlock->append(
-					new mips::Branch(currentBlock, processOperand(I.getCondition()), I.getSuccessor(0),
-							false));    //beqz
+			branch(I.getSuccessor(0), true);
 		else if (!first && !second) {
-			currentBlock->append(
-					new mips::Branch(currentBlock, processOperand(I.getCondition()), I.getSuccessor(1),
-							true));   // bneqz
+			branch(I.getSuccessor(1), false);
 			currentBlock->append(new mips::Jump(currentBlock, I.getSuccessor(0)));
 		}
 	}
-	else {
+	else if (currentBlock->getBlock()->getNextNode()!=I.getSuccessor(0)) {
 		currentBlock->append(new mips::Jump(currentBlock, I.getSuccessor(0)));
 	}
 }
 
+void MIPSVisitor::visitUnreachableInst(UnreachableInst& I)
+{
+	// control never reaches this point, so there is nothing to emit
+}
+
 void MIPSVisitor::visitBinaryOperator(BinaryOperator& I)
 {
 	const auto& a = &I;
@@ -304,48 +362,69 @@ void MIPSVisitor::visitBinaryOperator(BinaryOperator& I)
 	const auto& c = processOperand(I.getOperand(1));
 	mips::Instruction* instruction;
 
+	// operations with a constant operand are strength reduced
+	const auto constant = I.getType()->isIntegerTy(32) ? dyn_cast<ConstantInt>(c) : nullptr;
+	const auto immediate = (constant && !constant->isZero() && !isa<Constant>(b)) ? constant : nullptr;
+
 	switch (I.getOpcode()) {
 	case llvm::Instruction::Add:
-		instruction = new mips::Arithmetic(currentBlock, "add", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::add, a, b, c);
 		break;
 	case llvm::Instruction::FAdd:
-		instruction = new mips::Arithmetic(currentBlock, "add.s", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::add_s, a, b, c);
 		break;
 	case llvm::Instruction::Sub:
-		instruction = new mips::Arithmetic(currentBlock, "sub", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sub, a, b, c);
 		break;
 	case llvm::Instruction::FSub:
-		instruction = new mips::Arithmetic(currentBlock, "sub.s", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::sub_s, a, b, c);
 		break;
 	case llvm::Instruction::Mul:
-		instruction = new mips::Arithmetic(currentBlock, "mul", a, b, c);
+		if (immediate)
+			instruction = new mips::Multiply(currentBlock, a, b, immediate);
+		else if (I.getType()->isIntegerTy(32) && isa<ConstantInt>(b) && !isa<Constant>(c))
+			instruction = new mips::Multiply(currentBlock, a, c, cast<ConstantInt>(b));
+		else
+			instruction = new mips::Arithmetic(currentBlock, Opcode::mul, a, b, c);
 		break;
 	case llvm::Instruction::FMul:
-		instruction = new mips::Arithmetic(currentBlock, "mul.s", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::mul_s, a, b, c);
 		break;
 	case llvm::Instruction::UDiv:
-		instruction = new mips::Arithmetic(currentBlock, "divu", a, b, c);
+		if (immediate)
+			instruction = new mips::Divide(currentBlock, a, b, immediate, false, false);
+		else
+			instruction = new mips::Arithmetic(currentBlock, Opcode::divu, a, b, c);
 		break;
 	case llvm::Instruction::SDiv:
-		instruction = new mips::Arithmetic(currentBlock, "div", a, b, c);
+		if (immediate)
+			instruction = new mips::Divide(currentBlock, a, b, immediate, true, false);
+		else
+			instruction = new mips::Arithmetic(currentBlock, Opcode::div, a, b, c);
 		break;
 	case llvm::Instruction::FDiv:
-		instruction = new mips::Arithmetic(currentBlock, "div.s", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::div_s, a, b, c);
 		break;
 	case llvm::Instruction::URem:
-		instruction = new Modulo(currentBlock, a, b, c);
+		if (immediate)
+			instruction = new mips::Divide(currentBlock, a, b, immediate, false, true);
+		else
+			instruction = new Modulo(currentBlock, a, b, c, false);
 		break;
 	case llvm::Instruction::SRem:
-		instruction = new Modulo(currentBlock, a, b, c);
+		if (immediate)
+			instruction = new mips::Divide(currentBlock, a, b, immediate, true, true);
+		else
+			instruction = new Modulo(currentBlock, a, b, c, true);
 		break;
 	case llvm::Instruction::And:
-		instruction = new mips::Arithmetic(currentBlock, "and", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::and_, a, b, c);
 		break;
 	case llvm::Instruction::Or:
-		instruction = new mips::Arithmetic(currentBlock, "or", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::or_, a, b, c);
 		break;
 	case llvm::Instruction::Xor:
-		instruction = new mips::Arithmetic(currentBlock, "xor", a, b, c);
+		instruction = new mips::Arithmetic(currentBlock, Opcode::xor_, a, b, c);
 		break;
 	default:
 		InstVisitor::visitBinaryOperator(I);
@@ -362,6 +441,49 @@ void MIPSVisitor::visitInstruction(llvm::Instruction& I)
 	throw InternalError("IR instruction '"+str+"' is not implemented in MIPS (try turning optimizations off)");
 }
 
+void MIPSVisitor::copyPhiValues(BranchInst& I)
+{
+	// the critical edges are split, so a block with several successors is the only predecessor of those with phis,
+	// apart from the latch of a loop whose exit has no phis, and the copies for one successor are dead in the other.
+	// No phi reads another phi of its block, so the copies of one edge do not depend on each other's order.
+	for (auto* successor: I.successors()) {
+		for (auto& phi: successor->phis()) {
+			const auto incoming = phi.getIncomingValueForBlock(I.getParent());
+			if (phi.use_empty() || incoming==&phi) continue;
+			currentBlock->append(
+					new mips::Move(currentBlock, &phi, processOperand(incoming)));
+		}
+	}
+}
+
+bool MIPSVisitor::isFoldable(llvm::GEPOperator* pointer) const
+{
+	APInt offset(32, 0);
+	if (!pointer->accumulateConstantOffset(module.layout, offset) || !offset.isSignedIntN(16)) return false;
+
+	// a constant expression is converted again for every use, an instruction is only skipped when no use needs it,
+	// the ones processOperand makes of a constant expression have no uses at all
+	if (isa<ConstantExpr>(pointer)) return true;
+	return !pointer->user_empty() && all_of(pointer->users(), [&](const auto* user) {
+		if (const auto* load = dyn_cast<LoadInst>(user)) return load->getPointerOperand()==pointer;
+		if (const auto* store = dyn_cast<StoreInst>(user)) return store->getValueOperand()!=pointer;
+		return false;
+	});
+}
+
+std::pair<llvm::Value*, int> MIPSVisitor::foldAddress(llvm::Value* pointer)
+{
+	int offset = 0;
+	while (auto* gep = dyn_cast<GEPOperator>(pointer)) {
+		APInt a(32, 0);
+		if (!isFoldable(gep) || !gep->accumulateConstantOffset(module.layout, a)) break;
+		if (!isInt<16>(offset+a.getSExtValue())) break;
+		offset += static_cast<int>(a.getSExtValue());
+		pointer = gep->getPointerOperand();
+	}
+	return {processOperand(pointer), offset};
+}
+
 llvm::Value* MIPSVisitor::processOperand(llvm::Value* value)
 {
 	ConstantExpr* c;
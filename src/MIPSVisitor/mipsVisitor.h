@@ -6,17 +6,22 @@
 #define COMPILER_MIPSVISITOR_H
 
 #include <llvm/IR/InstVisitor.h>
+#include <llvm/IR/Operator.h>
 #include <filesystem>
 #include "mips.h"
 
 class MIPSVisitor : public llvm::InstVisitor<MIPSVisitor> {
 public:
-	explicit MIPSVisitor(const llvm::Module& module);
+	explicit MIPSVisitor(const llvm::Module& module, mips::Allocator allocator = mips::Allocator::linear);
 
 	void convertIR(llvm::Module& module);
 
 	void print(const std::filesystem::path& output);
 
+	[[nodiscard]] mips::SpillStatistics getStatistics() const;
+
+	[[nodiscard]] std::vector<std::pair<std::string, size_t>> getPeepholeHits() const;
+
 	[[maybe_unused]] void visitModule(llvm::Module& M);
 
 	[[maybe_unused]] void visitFunction(llvm::Function& F);
@@ -59,22 +64,40 @@ public:
 
 	[[maybe_unused]] void visitBitCastInst(llvm::BitCastInst& I);
 
+	[[maybe_unused]] void visitSelectInst(llvm::SelectInst& I);
+
 	[[maybe_unused]] void visitCallInst(llvm::CallInst& I);
 
 	[[maybe_unused]] void visitReturnInst(llvm::ReturnInst& I);
 
 	[[maybe_unused]] void visitBranchInst(llvm::BranchInst& I);
 
+	[[maybe_unused]] void visitUnreachableInst(llvm::UnreachableInst& I);
+
 	[[maybe_unused]] void visitBinaryOperator(llvm::BinaryOperator& I);
 
 	[[maybe_unused]] void visitInstruction(llvm::Instruction& I);
 
 private:
 	mips::Module module;
+	mips::Allocator allocator;
 	mips::Function* currentFunction;
 	mips::Block* currentBlock;
 
 	llvm::Value* processOperand(llvm::Value* value);
+
+	// a pointer at a constant offset from its base that is only used to load and store is not computed
+	bool isFoldable(llvm::GEPOperator* pointer) const;
+
+	// the base and the offset the address of a load or store is made of
+	std::pair<llvm::Value*, int> foldAddress(llvm::Value* pointer);
+
+	// an integer compare that only a conditional branch uses is emitted with the branch
+	bool isFusable(const llvm::ICmpInst& I) const;
+
+	bool isSiblingCall(const llvm::CallInst& I) const;
+
+	void copyPhiValues(llvm::BranchInst& I);
 };
 
 #endif //COMPILER_MIPSVISITOR_H
@@ -0,0 +1,298 @@
+#include "peephole.h"
+
+#include <algorithm>
+#include <set>
+
+namespace
+{
+using namespace mips;
+
+bool isLoad(Opcode opcode)
+{
+    return opcode == Opcode::lw or opcode == Opcode::lb or opcode == Opcode::lwc1 or opcode == Opcode::l_s;
+}
+
+bool isStore(Opcode opcode)
+{
+    return opcode == Opcode::sw or opcode == Opcode::sb or opcode == Opcode::swc1 or opcode == Opcode::s_s;
+}
+
+// the block that runs when the given one falls through its end, or nullptr after the last block
+MachineBlock* getNext(const MachineFunction& function, const MachineBlock& block)
+{
+    const auto& blocks = function.getBlocks();
+    const auto iter = std::find_if(blocks.begin(), blocks.end(), [&](const auto& ptr) { return ptr.get() == &block; });
+    return (iter == blocks.end() or iter + 1 == blocks.end()) ? nullptr : (iter + 1)->get();
+}
+
+// whether the target runs right after the block when it falls through its end, empty blocks in between are skipped
+bool fallsThroughTo(const MachineFunction& function, const MachineBlock& block, const MachineBlock* target)
+{
+    for(auto* next = getNext(function, block); next != nullptr; next = getNext(function, *next))
+    {
+        if(next == target) return true;
+        if(not next->getInstructions().empty()) return false;
+    }
+    return false;
+}
+
+// whether every path from the instruction after start writes the register before it reads it
+bool isDead(const MachineFunction& function, const MachineBlock& block, size_t start, int index, std::set<const MachineBlock*>& visited)
+{
+    const auto& instructions = block.getInstructions();
+    for(auto i = start; i < instructions.size(); i++)
+    {
+        const auto* instruction = instructions[i];
+        if(instruction->reads(index)) return false;
+        if(instruction->getDefinition() == index) return true;
+
+        // the register has to be dead in the target of a branch, a jump does not continue in this block
+        for(const auto& operand : instruction->operands)
+        {
+            if(operand.kind != Operand::Kind::block or not visited.insert(operand.block).second) continue;
+            if(not isDead(function, *operand.block, 0, index, visited)) return false;
+        }
+        if(instruction->isJump()) return true;
+    }
+    const auto* next = getNext(function, block);
+    if(next == nullptr) return false;
+    return not visited.insert(next).second or isDead(function, *next, 0, index, visited);
+}
+
+bool isDeadAfter(const MachineFunction& function, const MachineBlock& block, size_t index, int reg)
+{
+    std::set<const MachineBlock*> visited;
+    return isDead(function, block, index + 1, reg, visited);
+}
+
+// move $x,$x
+bool removeSelfMove(const MachineFunction& function, MachineBlock& block, size_t index)
+{
+    auto& instructions = block.getInstructions();
+    if(instructions[index]->operands[0] != instructions[index]->operands[1]) return false;
+
+    instructions.erase(instructions.begin() + index);
+    return true;
+}
+
+// move $x,$y followed by move $y,$x
+bool removeMoveBack(const MachineFunction& function, MachineBlock& block, size_t index)
+{
+    auto& instructions = block.getInstructions();
+    if(index + 1 >= instructions.size()) return false;
+
+    const auto* first = instructions[index];
+    const auto* second = instructions[index + 1];
+    if(second->opcode != first->opcode or second->operands[0] != first->operands[1] or second->operands[1] != first->operands[0])
+    {
+        return false;
+    }
+    instructions.erase(instructions.begin() + index + 1);
+    return true;
+}
+
+// sw $x,address followed by lw $y,address becomes move $y,$x
+bool forwardStore(const MachineFunction& function, MachineBlock& block, size_t index)
+{
+    auto& instructions = block.getInstructions();
+    if(index + 1 >= instructions.size()) return false;
+
+    const auto* store = instructions[index];
+    auto* load = instructions[index + 1];
+    const auto matches = store->opcode == Opcode::sw ? load->opcode == Opcode::lw : load->opcode == Opcode::lwc1;
+    if(not matches or load->operands[1] != store->operands[1]) return false;
+
+    if(load->operands[0] == store->operands[0])
+    {
+        instructions.erase(instructions.begin() + index + 1);
+    }
+    else
+    {
+        load->opcode = store->opcode == Opcode::sw ? Opcode::move : Opcode::mov_s;
+        load->operands[1] = store->operands[0];
+    }
+    return true;
+}
+
+// li or la of the value the register still holds since the last time it was loaded in the block
+bool removeReloadedConstant(const MachineFunction& function, MachineBlock& block, size_t index)
+{
+    auto& instructions = block.getInstructions();
+    const auto* load = instructions[index];
+    const auto& value = load->operands[1];
+
+    for(auto i = index; i-- > 0;)
+    {
+        const auto* instruction = instructions[i];
+        if(instruction->opcode == Opcode::jal) return false;
+
+        const auto definition = instruction->getDefinition();
+        if(value.kind == Operand::Kind::address and definition == value.reg) return false;
+        if(definition != load->operands[0].reg) continue;
+
+        if(instruction->opcode != load->opcode or instruction->operands[1] != value) return false;
+        instructions.erase(instructions.begin() + index);
+        return true;
+    }
+    return false;
+}
+
+// la $t,address followed by a load or store through $t uses the address directly when $t is not read afterwards
+bool foldAddress(const MachineFunction& function, MachineBlock& block, size_t index)
+{
+    auto& instructions = block.getInstructions();
+    if(index + 1 >= instructions.size()) return false;
+
+    const auto* la = instructions[index];
+    auto* access = instructions[index + 1];
+    const auto temp = la->operands[0].reg;
+    const auto& value = la->operands[1];
+    auto& pointer = access->operands[1];
+
+    if(not isLoad(access->opcode) and not isStore(access->opcode)) return false;
+    if(pointer.kind != Operand::Kind::address or pointer.reg != temp) return false;
+    if(isStore(access->opcode) and access->operands[0].reg == temp) return false;
+
+    const auto overwritten = isLoad(access->opcode) and access->operands[0].reg == temp;
+    if(not overwritten and not isDeadAfter(function, block, index + 1, temp)) return false;
+
+    pointer = value.kind == Operand::Kind::symbol ? symbol(value.symbol, value.imm + pointer.imm)
+                                                  : address(value.imm + pointer.imm, value.reg);
+    instructions.erase(instructions.begin() + index);
+    return true;
+}
+
+// j to the block that comes next anyway
+bool removeJumpToNext(const MachineFunction& function, MachineBlock& block, size_t index)
+{
+    auto& instructions = block.getInstructions();
+    const auto& target = instructions[index]->operands[0];
+    if(index + 1 != instructions.size() or target.kind != Operand::Kind::block) return false;
+    if(not fallsThroughTo(function, block, target.block)) return false;
+
+    instructions.pop_back();
+    return true;
+}
+
+// the branch that is taken exactly when the given one is not
+Opcode invert(Opcode opcode)
+{
+    switch(opcode)
+    {
+        case Opcode::beqz: return Opcode::bnez;
+        case Opcode::bnez: return Opcode::beqz;
+        case Opcode::beq: return Opcode::bne;
+        case Opcode::bne: return Opcode::beq;
+        case Opcode::blez: return Opcode::bgtz;
+        case Opcode::bgtz: return Opcode::blez;
+        case Opcode::bltz: return Opcode::bgez;
+        case Opcode::bgez: return Opcode::bltz;
+        default: return opcode;
+    }
+}
+
+// whether a branch or jump in the function goes to the block
+bool isTargeted(const MachineFunction& function, const MachineBlock* target)
+{
+    for(const auto& block : function.getBlocks())
+    {
+        for(const auto* instruction : block->getInstructions())
+        {
+            for(const auto& operand : instruction->operands)
+            {
+                if(operand.kind == Operand::Kind::block and operand.block == target) return true;
+            }
+        }
+    }
+    return false;
+}
+
+// beqz $x,next followed by j other becomes bnez $x,other, the same goes for the other branches,
+// the jump may also be alone in the block that only this one falls through to, like the back edge of a rotated loop
+bool invertBranch(const MachineFunction& function, MachineBlock& block, size_t index)
+{
+    auto& instructions = block.getInstructions();
+    auto* jumpBlock = &block;
+    if(index + 1 == instructions.size())
+    {
+        do
+        {
+            jumpBlock = getNext(function, *jumpBlock);
+            if(jumpBlock == nullptr or isTargeted(function, jumpBlock)) return false;
+        } while(jumpBlock->getInstructions().empty());
+        if(jumpBlock->getInstructions().size() != 1) return false;
+    }
+    else if(index + 2 != instructions.size()) return false;
+
+    auto* branch = instructions[index];
+    auto& jumps = jumpBlock->getInstructions();
+    const auto* jump = jumps.back();
+    if(jump->opcode != Opcode::j or jump->operands[0].kind != Operand::Kind::block) return false;
+    if(jumpBlock != &block and jump->operands[0].block == jumpBlock) return false;
+
+    // beq and bne compare two registers, the others one
+    auto& target = branch->operands[branch->opcode == Opcode::beq or branch->opcode == Opcode::bne ? 2 : 1];
+    if(not fallsThroughTo(function, *jumpBlock, target.block)) return false;
+
+    branch->opcode = invert(branch->opcode);
+    target = jump->operands[0];
+    jumps.pop_back();
+    return true;
+}
+
+const std::vector<PeepholeRule> rules = {
+    {"self move", {Opcode::move, Opcode::mov_s}, removeSelfMove},
+    {"move back", {Opcode::move, Opcode::mov_s}, removeMoveBack},
+    {"store and load", {Opcode::sw, Opcode::swc1}, forwardStore},
+    {"reloaded constant", {Opcode::li, Opcode::la}, removeReloadedConstant},
+    {"address folding", {Opcode::la}, foldAddress},
+    {"jump to next", {Opcode::j}, removeJumpToNext},
+    {"branch over jump",
+     {Opcode::beqz, Opcode::bnez, Opcode::beq, Opcode::bne, Opcode::blez, Opcode::bgtz, Opcode::bltz, Opcode::bgez},
+     invertBranch},
+};
+
+} // namespace
+
+namespace mips
+{
+
+Peephole::Peephole() : hits(rules.size(), 0)
+{
+}
+
+void Peephole::run(MachineFunction& function)
+{
+    for(auto changed = true; changed;)
+    {
+        changed = false;
+        for(const auto& block : function.getBlocks())
+        {
+            auto& instructions = block->getInstructions();
+            for(size_t i = 0; i < instructions.size(); i++)
+            {
+                for(size_t r = 0; r < rules.size() and i < instructions.size(); r++)
+                {
+                    const auto& opcodes = rules[r].opcodes;
+                    if(std::find(opcodes.begin(), opcodes.end(), instructions[i]->opcode) == opcodes.end()) continue;
+                    if(not rules[r].apply(function, *block, i)) continue;
+                    hits[r]++;
+                    changed = true;
+                }
+            }
+        }
+    }
+    function.link();
+}
+
+std::vector<std::pair<std::string, size_t>> Peephole::getHits() const
+{
+    std::vector<std::pair<std::string, size_t>> result;
+    for(size_t r = 0; r < rules.size(); r++)
+    {
+        result.emplace_back(rules[r].name, hits[r]);
+    }
+    return result;
+}
+
+} // namespace mips
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "machine.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mips
+{
+
+// a rewrite of a short sequence of machine instructions
+struct PeepholeRule
+{
+    const char* name;
+
+    // the rule is only tried on an instruction with one of these opcodes, the start of the sequence
+    std::vector<Opcode> opcodes;
+
+    // rewrites the sequence that starts at the index, returns false when it does not match
+    bool (*apply)(const MachineFunction& function, MachineBlock& block, size_t index);
+};
+
+// applies the rules to every instruction until none of them matches anymore, the rules may enable each other
+class Peephole
+{
+    public:
+    Peephole();
+
+    void run(MachineFunction& function);
+
+    // the name of every rule with the number of times it was applied
+    [[nodiscard]] std::vector<std::pair<std::string, size_t>> getHits() const;
+
+    private:
+    std::vector<size_t> hits;
+};
+
+} // namespace mips
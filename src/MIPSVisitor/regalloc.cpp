@@ -0,0 +1,677 @@
+#include "regalloc.h"
+#include "mips.h"
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Instructions.h>
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+namespace mips
+{
+
+SpillStatistics& SpillStatistics::operator+=(const SpillStatistics& rhs)
+{
+    values += rhs.values;
+    loads += rhs.loads;
+    stores += rhs.stores;
+    dynamicLoads += rhs.dynamicLoads;
+    dynamicStores += rhs.dynamicStores;
+    return *this;
+}
+
+bool isRegisterValue(llvm::Value* value)
+{
+    if(value->getType()->isVoidTy()) return false;
+    if(llvm::isa<llvm::Argument>(value)) return true;
+    return llvm::isa<llvm::Instruction>(value) and not llvm::isa<llvm::AllocaInst>(value);
+}
+
+Liveness liveness(Function* function)
+{
+    const auto& blocks = function->getBlocks();
+
+    // every value gets an index, so the live sets can be bit vectors, the arguments come first
+    Liveness live;
+    const auto index = [&](llvm::Value* value) {
+        const auto [iter, inserted] = live.indices.try_emplace(value, live.values.size());
+        if(inserted) live.values.push_back(value);
+        return iter->second;
+    };
+    for(auto& argument : function->getFunction()->args())
+    {
+        index(&argument);
+    }
+    for(const auto& block : blocks)
+    {
+        for(const auto& instruction : block->getInstructions())
+        {
+            for(auto* value : instruction->getUses()) if(isRegisterValue(value)) index(value);
+            for(auto* value : instruction->getDefs()) if(isRegisterValue(value)) index(value);
+        }
+    }
+
+    const auto count = live.values.size();
+    live.costs.resize(count);
+    std::vector<llvm::BitVector> gen(blocks.size(), llvm::BitVector(count));
+    std::vector<llvm::BitVector> kill(blocks.size(), llvm::BitVector(count));
+    live.in.resize(blocks.size(), llvm::BitVector(count));
+    live.out.resize(blocks.size(), llvm::BitVector(count));
+
+    std::map<llvm::BasicBlock*, size_t> order;
+    for(size_t i = 0; i < blocks.size(); i++)
+    {
+        order.emplace(blocks[i]->getBlock(), i);
+    }
+
+    for(size_t i = 0; i < blocks.size(); i++)
+    {
+        // uses before a definition in the block make the value live in
+        const auto weight = std::pow(10.0, std::min(blocks[i]->depth, 8u));
+        for(const auto& instruction : blocks[i]->getInstructions())
+        {
+            for(auto* value : instruction->getUses())
+            {
+                if(not isRegisterValue(value)) continue;
+                const auto j = live.indices[value];
+                if(not kill[i].test(j)) gen[i].set(j);
+                live.costs[j] += weight;
+            }
+            for(auto* value : instruction->getDefs())
+            {
+                if(not isRegisterValue(value)) continue;
+                const auto j = live.indices[value];
+                kill[i].set(j);
+                live.costs[j] += weight;
+            }
+        }
+    }
+
+    // live out is the union of the live in of the successors, live in adds the uses to what is not killed
+    for(auto changed = true; changed;)
+    {
+        changed = false;
+        for(auto i = blocks.size(); i-- > 0;)
+        {
+            for(auto* successor : llvm::successors(blocks[i]->getBlock()))
+            {
+                if(const auto iter = order.find(successor); iter != order.end()) live.out[i] |= live.in[iter->second];
+            }
+            auto in = live.out[i];
+            in.reset(kill[i]);
+            in |= gen[i];
+            if(in != live.in[i])
+            {
+                live.in[i] = std::move(in);
+                changed = true;
+            }
+        }
+    }
+
+    // walking every block backwards from its live out set finds the values that are live after a call
+    live.clobbered.resize(count);
+    for(size_t i = 0; i < blocks.size(); i++)
+    {
+        auto current = live.out[i];
+        const auto& instructions = blocks[i]->getInstructions();
+        for(auto iter = instructions.rbegin(); iter != instructions.rend(); ++iter)
+        {
+            for(auto* value : (*iter)->getDefs()) if(isRegisterValue(value)) current.reset(live.indices.at(value));
+            if(const auto clobbers = (*iter)->getClobbers(); clobbers.any())
+            {
+                for(const auto j : current.set_bits()) live.clobbered[j] |= clobbers;
+            }
+            for(auto* value : (*iter)->getUses()) if(isRegisterValue(value)) current.set(live.indices.at(value));
+        }
+    }
+    return live;
+}
+
+std::vector<Interval> liveIntervals(Function* function, const Liveness& live)
+{
+    const auto& blocks = function->getBlocks();
+
+    std::vector<Interval> intervals;
+    for(auto* value : live.values)
+    {
+        intervals.push_back(Interval{value, value->getType()->isFloatTy()});
+        intervals.back().clobbered = live.clobbered[intervals.size() - 1];
+    }
+
+    const auto extend = [&](size_t i, int position) {
+        intervals[i].start = std::min(intervals[i].start, position);
+        intervals[i].end = std::max(intervals[i].end, position);
+    };
+
+    // the arguments are defined at position 0, every block starts with a position for its label
+    for(auto& argument : function->getFunction()->args())
+    {
+        extend(live.indices.at(&argument), 0);
+    }
+
+    auto position = 1;
+    for(size_t i = 0; i < blocks.size(); i++)
+    {
+        for(const auto j : live.in[i].set_bits()) extend(j, position);
+        position++;
+
+        for(const auto& instruction : blocks[i]->getInstructions())
+        {
+            for(auto* value : instruction->getUses()) if(isRegisterValue(value)) extend(live.indices.at(value), position);
+            for(auto* value : instruction->getDefs()) if(isRegisterValue(value)) extend(live.indices.at(value), position);
+            position++;
+        }
+        for(const auto j : live.out[i].set_bits()) extend(j, position - 1);
+    }
+
+    for(size_t i = 0; i < intervals.size(); i++)
+    {
+        intervals[i].weight = live.costs[i] / (intervals[i].end - intervals[i].start + 1);
+    }
+    return intervals;
+}
+
+void linearScan(std::vector<Interval>& intervals, const RegisterFile& registers)
+{
+    std::vector<Interval*> sorted;
+    for(auto& interval : intervals)
+    {
+        sorted.push_back(&interval);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](auto* lhs, auto* rhs) { return lhs->start < rhs->start; });
+
+    const auto isCalleeSaved = [&](bool fl, int reg) {
+        const auto& saved = registers.calleeSaved[fl];
+        return std::find(saved.begin(), saved.end(), reg) != saved.end();
+    };
+
+    // the free registers of both kinds, the caller saved ones are handed out first as they need no saving
+    auto callerSaved = registers.callerSaved;
+    auto calleeSaved = registers.calleeSaved;
+    const auto pool = [&](bool fl, int reg) -> std::vector<int>& {
+        return isCalleeSaved(fl, reg) ? calleeSaved[fl] : callerSaved[fl];
+    };
+
+    std::array<std::vector<Interval*>, 2> active;
+    for(auto* current : sorted)
+    {
+        const auto fl = current->fl;
+        auto& intervals = active[fl];
+
+        // the intervals that ended before this one give their register back
+        for(auto iter = intervals.begin(); iter != intervals.end();)
+        {
+            if((*iter)->end >= current->start)
+            {
+                ++iter;
+                continue;
+            }
+            pool(fl, (*iter)->reg).push_back((*iter)->reg);
+            iter = intervals.erase(iter);
+        }
+
+        const auto allowed = [&](int reg) { return isCalleeSaved(fl, reg) or not current->clobbered.test(reg + 32 * fl); };
+        if(current->hint != -1 and allowed(current->hint))
+        {
+            auto& free = pool(fl, current->hint);
+            if(const auto iter = std::find(free.begin(), free.end(), current->hint); iter != free.end())
+            {
+                current->reg = *iter;
+                free.erase(iter);
+            }
+        }
+        for(auto* free : {&callerSaved[fl], &calleeSaved[fl]})
+        {
+            if(current->reg != -1) break;
+            const auto iter = std::find_if(free->rbegin(), free->rend(), allowed);
+            if(iter == free->rend()) continue;
+            current->reg = *iter;
+            free->erase(std::next(iter).base());
+        }
+        if(current->reg != -1)
+        {
+            intervals.push_back(current);
+            continue;
+        }
+
+        // the value that is used least per position goes to the stack, which may be the current one
+        Interval** victim = nullptr;
+        for(auto& interval : intervals)
+        {
+            if(allowed(interval->reg) and (victim == nullptr or interval->weight < (*victim)->weight)) victim = &interval;
+        }
+        if(victim != nullptr and (*victim)->weight < current->weight)
+        {
+            current->reg = (*victim)->reg;
+            (*victim)->reg = -1;
+            *victim = current;
+        }
+    }
+}
+
+namespace
+{
+
+// the state of the nodes and moves of iterated register coalescing, following Appel's Modern Compiler Implementation
+class Coalescer
+{
+    public:
+    Coalescer(Function* function, const Liveness& live, const std::vector<Interval>& intervals, const RegisterFile& registers)
+    : live(live), registers(registers)
+    {
+        const auto count = live.values.size();
+        adjacent.resize(count, llvm::BitVector(count));
+        adjacency.resize(count);
+        degree.resize(count);
+        moveList.resize(count);
+        alias.resize(count);
+        color.resize(count, -1);
+        state.resize(count, State::initial);
+        fl.resize(count);
+        clobbered.resize(count);
+        hint.resize(count);
+        for(size_t i = 0; i < count; i++)
+        {
+            fl[i] = intervals[i].fl;
+            clobbered[i] = intervals[i].clobbered;
+            hint[i] = intervals[i].hint;
+        }
+        build(function);
+    }
+
+    void run()
+    {
+        makeWorklist();
+        while(not simplifyWorklist.empty() or not worklistMoves.empty() or not freezeWorklist.empty() or
+              not spillWorklist.empty())
+        {
+            if(not simplifyWorklist.empty()) simplify();
+            else if(not worklistMoves.empty()) coalesce();
+            else if(not freezeWorklist.empty()) freeze();
+            else selectSpill();
+        }
+        assignColors();
+    }
+
+    [[nodiscard]] int getColor(size_t node) const
+    {
+        return color[node];
+    }
+
+    private:
+    enum class State
+    {
+        initial,
+        simplify,
+        freeze,
+        spill,
+        coalesced,
+        selected
+    };
+
+    enum class MoveState
+    {
+        worklist,
+        active,
+        coalesced,
+        constrained,
+        frozen
+    };
+
+    void addEdge(size_t u, size_t v)
+    {
+        if(u == v or fl[u] != fl[v] or adjacent[u].test(v)) return;
+        adjacent[u].set(v);
+        adjacent[v].set(u);
+        adjacency[u].push_back(v);
+        adjacency[v].push_back(u);
+        degree[u]++;
+        degree[v]++;
+    }
+
+    // walks every block backwards from its live out set, the destination of a move does not interfere with its source
+    void build(Function* function)
+    {
+        const auto& blocks = function->getBlocks();
+        const auto index = [&](llvm::Value* value) { return live.indices.at(value); };
+
+        for(size_t i = 0; i < blocks.size(); i++)
+        {
+            auto current = live.out[i];
+            const auto& instructions = blocks[i]->getInstructions();
+            for(auto iter = instructions.rbegin(); iter != instructions.rend(); ++iter)
+            {
+                std::vector<size_t> uses;
+                std::vector<size_t> defs;
+                for(auto* value : (*iter)->getUses()) if(isRegisterValue(value)) uses.push_back(index(value));
+                for(auto* value : (*iter)->getDefs()) if(isRegisterValue(value)) defs.push_back(index(value));
+
+                if(dynamic_cast<Move*>(iter->get()) and uses.size() == 1 and defs.size() == 1 and
+                   fl[uses[0]] == fl[defs[0]])
+                {
+                    current.reset(uses[0]);
+                    moves.emplace_back(defs[0], uses[0]);
+                    moveStates.push_back(MoveState::worklist);
+                    moveList[defs[0]].push_back(moves.size() - 1);
+                    moveList[uses[0]].push_back(moves.size() - 1);
+                    worklistMoves.insert(moves.size() - 1);
+                }
+                else if((*iter)->isEarlyClobber())
+                {
+                    for(const auto d : defs) for(const auto u : uses) addEdge(d, u);
+                }
+
+                for(const auto d : defs) current.set(d);
+                for(const auto d : defs) for(const auto l : current.set_bits()) addEdge(d, l);
+                for(const auto d : defs) current.reset(d);
+                for(const auto u : uses) current.set(u);
+            }
+        }
+
+        // the arguments are all loaded in the prologue, before anything else is live
+        auto entry = live.in.empty() ? llvm::BitVector(live.values.size()) : live.in.front();
+        for(auto& argument : function->getFunction()->args()) entry.set(index(&argument));
+        for(auto& argument : function->getFunction()->args())
+        {
+            for(const auto l : entry.set_bits()) addEdge(index(&argument), l);
+        }
+    }
+
+    [[nodiscard]] bool allowed(bool floating, const RegisterMask& clobbers, int reg) const
+    {
+        const auto& saved = registers.calleeSaved[floating];
+        return std::find(saved.begin(), saved.end(), reg) != saved.end() or not clobbers.test(reg + 32 * floating);
+    }
+
+    // the amount of registers the node may get, a value over a call loses the ones that the call overwrites
+    [[nodiscard]] size_t colors(bool floating, const RegisterMask& clobbers) const
+    {
+        const auto& others = registers.callerSaved[floating];
+        const auto kept = std::count_if(others.begin(), others.end(), [&](auto reg) { return allowed(floating, clobbers, reg); });
+        return registers.calleeSaved[floating].size() + kept;
+    }
+
+    [[nodiscard]] size_t colors(size_t node) const
+    {
+        return colors(fl[node], clobbered[node]);
+    }
+
+    // the neighbours that are still in the graph
+    template <typename Callback>
+    void forAdjacent(size_t node, Callback callback)
+    {
+        for(const auto neighbour : adjacency[node])
+        {
+            if(state[neighbour] != State::selected and state[neighbour] != State::coalesced) callback(neighbour);
+        }
+    }
+
+    [[nodiscard]] bool moveRelated(size_t node) const
+    {
+        return std::any_of(moveList[node].begin(), moveList[node].end(), [&](auto move) {
+            return moveStates[move] == MoveState::worklist or moveStates[move] == MoveState::active;
+        });
+    }
+
+    void setState(size_t node, State next)
+    {
+        switch(state[node])
+        {
+            case State::simplify: simplifyWorklist.erase(node); break;
+            case State::freeze: freezeWorklist.erase(node); break;
+            case State::spill: spillWorklist.erase(node); break;
+            default: break;
+        }
+        switch(next)
+        {
+            case State::simplify: simplifyWorklist.insert(node); break;
+            case State::freeze: freezeWorklist.insert(node); break;
+            case State::spill: spillWorklist.insert(node); break;
+            default: break;
+        }
+        state[node] = next;
+    }
+
+    void makeWorklist()
+    {
+        for(size_t node = 0; node < live.values.size(); node++)
+        {
+            if(degree[node] >= colors(node)) setState(node, State::spill);
+            else if(moveRelated(node)) setState(node, State::freeze);
+            else setState(node, State::simplify);
+        }
+    }
+
+    void enableMoves(size_t node)
+    {
+        for(const auto move : moveList[node])
+        {
+            if(moveStates[move] != MoveState::active) continue;
+            moveStates[move] = MoveState::worklist;
+            worklistMoves.insert(move);
+        }
+    }
+
+    void decrementDegree(size_t node)
+    {
+        if(degree[node]-- != colors(node)) return;
+
+        enableMoves(node);
+        forAdjacent(node, [&](auto neighbour) { enableMoves(neighbour); });
+        setState(node, moveRelated(node) ? State::freeze : State::simplify);
+    }
+
+    void simplify()
+    {
+        const auto node = *simplifyWorklist.begin();
+        setState(node, State::selected);
+        selectStack.push_back(node);
+        forAdjacent(node, [&](auto neighbour) { decrementDegree(neighbour); });
+    }
+
+    size_t getAlias(size_t node) const
+    {
+        while(state[node] == State::coalesced) node = alias[node];
+        return node;
+    }
+
+    void addWorklist(size_t node)
+    {
+        if(state[node] == State::freeze and not moveRelated(node) and degree[node] < colors(node))
+        {
+            setState(node, State::simplify);
+        }
+    }
+
+    // Briggs: the merged node has fewer neighbours of significant degree than there are colors
+    bool conservative(size_t u, size_t v)
+    {
+        llvm::BitVector seen(live.values.size());
+        size_t significant = 0;
+        const auto count = [&](auto neighbour) {
+            if(seen.test(neighbour)) return;
+            seen.set(neighbour);
+            if(degree[neighbour] >= colors(neighbour)) significant++;
+        };
+        forAdjacent(u, count);
+        forAdjacent(v, count);
+        return significant < colors(fl[u], clobbered[u] | clobbered[v]);
+    }
+
+    void combine(size_t u, size_t v)
+    {
+        setState(v, State::coalesced);
+        alias[v] = u;
+        clobbered[u] |= clobbered[v];
+        if(hint[u] == -1) hint[u] = hint[v];
+        moveList[u].insert(moveList[u].end(), moveList[v].begin(), moveList[v].end());
+        enableMoves(v);
+        forAdjacent(v, [&](auto neighbour) {
+            addEdge(neighbour, u);
+            decrementDegree(neighbour);
+        });
+        if(degree[u] >= colors(u) and state[u] == State::freeze) setState(u, State::spill);
+    }
+
+    void coalesce()
+    {
+        const auto move = *worklistMoves.begin();
+        worklistMoves.erase(move);
+        const auto u = getAlias(moves[move].first);
+        const auto v = getAlias(moves[move].second);
+
+        if(u == v)
+        {
+            moveStates[move] = MoveState::coalesced;
+            addWorklist(u);
+        }
+        else if(adjacent[u].test(v))
+        {
+            moveStates[move] = MoveState::constrained;
+            addWorklist(u);
+            addWorklist(v);
+        }
+        else if(conservative(u, v))
+        {
+            moveStates[move] = MoveState::coalesced;
+            combine(u, v);
+            addWorklist(u);
+        }
+        else
+        {
+            moveStates[move] = MoveState::active;
+        }
+    }
+
+    void freezeMoves(size_t node)
+    {
+        for(const auto move : moveList[node])
+        {
+            if(moveStates[move] != MoveState::worklist and moveStates[move] != MoveState::active) continue;
+
+            const auto x = getAlias(moves[move].first);
+            const auto y = getAlias(moves[move].second);
+            const auto other = y == getAlias(node) ? x : y;
+
+            worklistMoves.erase(move);
+            moveStates[move] = MoveState::frozen;
+            if(state[other] == State::freeze and not moveRelated(other) and degree[other] < colors(other))
+            {
+                setState(other, State::simplify);
+            }
+        }
+    }
+
+    void freeze()
+    {
+        const auto node = *freezeWorklist.begin();
+        setState(node, State::simplify);
+        freezeMoves(node);
+    }
+
+    // the node that is used least per interference goes to the stack
+    void selectSpill()
+    {
+        const auto node = *std::min_element(spillWorklist.begin(), spillWorklist.end(), [&](auto lhs, auto rhs) {
+            return live.costs[lhs] / degree[lhs] < live.costs[rhs] / degree[rhs];
+        });
+        setState(node, State::simplify);
+        freezeMoves(node);
+    }
+
+    void assignColors()
+    {
+        while(not selectStack.empty())
+        {
+            const auto node = selectStack.back();
+            selectStack.pop_back();
+
+            std::set<int> taken;
+            for(const auto neighbour : adjacency[node])
+            {
+                const auto other = getAlias(neighbour);
+                if(state[other] == State::selected and color[other] != -1) taken.insert(color[other]);
+            }
+
+            // the hint avoids a move, then the caller saved registers are tried as they need no saving
+            const auto free = [&](int reg) { return taken.count(reg) == 0 and allowed(fl[node], clobbered[node], reg); };
+            if(hint[node] != -1 and free(hint[node]))
+            {
+                color[node] = hint[node];
+                continue;
+            }
+            for(const auto* available : {&registers.callerSaved[fl[node]], &registers.calleeSaved[fl[node]]})
+            {
+                const auto iter = std::find_if(available->rbegin(), available->rend(), free);
+                if(iter == available->rend()) continue;
+                color[node] = *iter;
+                break;
+            }
+        }
+        for(size_t node = 0; node < live.values.size(); node++)
+        {
+            if(state[node] == State::coalesced) color[node] = color[getAlias(node)];
+        }
+    }
+
+    const Liveness& live;
+    const RegisterFile& registers;
+
+    std::vector<llvm::BitVector> adjacent;
+    std::vector<std::vector<size_t>> adjacency;
+    std::vector<size_t> degree;
+    std::vector<bool> fl;
+    std::vector<RegisterMask> clobbered;
+    std::vector<int> hint;
+
+    std::vector<std::pair<size_t, size_t>> moves;
+    std::vector<MoveState> moveStates;
+    std::vector<std::vector<size_t>> moveList;
+    std::set<size_t> worklistMoves;
+
+    std::vector<State> state;
+    std::vector<size_t> alias;
+    std::vector<int> color;
+    std::set<size_t> simplifyWorklist;
+    std::set<size_t> freezeWorklist;
+    std::set<size_t> spillWorklist;
+    std::vector<size_t> selectStack;
+};
+
+} // namespace
+
+void graphColoring(Function* function, const Liveness& live, std::vector<Interval>& intervals,
+                   const RegisterFile& registers)
+{
+    Coalescer coalescer(function, live, intervals, registers);
+    coalescer.run();
+    for(size_t i = 0; i < intervals.size(); i++)
+    {
+        intervals[i].reg = coalescer.getColor(i);
+    }
+}
+
+int assignSpillSlots(const std::vector<Interval>& intervals, std::map<llvm::Value*, int>& slots)
+{
+    std::vector<const Interval*> spilled;
+    for(const auto& interval : intervals)
+    {
+        // arguments already have a place in the frame of the caller
+        if(interval.reg == -1 and not llvm::isa<llvm::Argument>(interval.value)) spilled.push_back(&interval);
+    }
+    std::stable_sort(spilled.begin(), spilled.end(), [](auto* lhs, auto* rhs) { return lhs->start < rhs->start; });
+
+    // the position at which each slot becomes free again
+    std::vector<int> ends;
+    for(const auto* interval : spilled)
+    {
+        auto slot = std::find_if(ends.begin(), ends.end(), [&](auto end) { return end < interval->start; }) - ends.begin();
+        if(slot == static_cast<long>(ends.size())) ends.emplace_back();
+
+        ends[slot] = interval->end;
+        slots.emplace(interval->value, slot);
+    }
+    return static_cast<int>(ends.size());
+}
+
+} // namespace mips
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <llvm/ADT/BitVector.h>
+#include <llvm/IR/Value.h>
+
+#include <array>
+#include <bitset>
+#include <limits>
+#include <map>
+#include <vector>
+
+namespace mips
+{
+
+class Function;
+
+enum class Allocator
+{
+    linear,
+    graph
+};
+
+// a set of registers by their number in the assembly, the float registers come after the 32 integer ones
+using RegisterMask = std::bitset<64>;
+
+// every value that lives in a register gets a dense index, the uses and definitions are weighted by 10^(loop depth)
+struct Liveness
+{
+    std::vector<llvm::Value*> values;
+    std::map<llvm::Value*, size_t> indices;
+    std::vector<double> costs;
+
+    // the values live in and out of every block, in the order of the blocks of the function
+    std::vector<llvm::BitVector> in;
+    std::vector<llvm::BitVector> out;
+
+    // the registers that the calls overwrite while the value is live
+    std::vector<RegisterMask> clobbered;
+};
+
+// the range of positions in which a value is live, from its first definition or live in block to its last use,
+// the instructions of a function are numbered in the order of the blocks
+struct Interval
+{
+    llvm::Value* value;
+    bool fl;
+
+    int start = std::numeric_limits<int>::max();
+    int end = std::numeric_limits<int>::min();
+
+    // the uses and definitions weighted by 10^(loop depth), divided by the length of the interval
+    double weight = 0;
+
+    // the registers overwritten by calls the value is live over, the callee saved ones survive every call
+    RegisterMask clobbered;
+
+    // the register the value is passed in, which avoids a move when it is free
+    int hint = -1;
+
+    // the register, or -1 if the value is spilled
+    int reg = -1;
+};
+
+// the registers the allocators may use, the callee saved ones keep their value over a call
+struct RegisterFile
+{
+    std::array<std::vector<int>, 2> callerSaved;
+    std::array<std::vector<int>, 2> calleeSaved;
+};
+
+// the loads and stores of spilled values, the dynamic counts are estimated by weighing them by 10^(loop depth)
+struct SpillStatistics
+{
+    size_t values = 0;
+    size_t loads = 0;
+    size_t stores = 0;
+    double dynamicLoads = 0;
+    double dynamicStores = 0;
+
+    SpillStatistics& operator+=(const SpillStatistics& rhs);
+};
+
+// only the results of instructions and the arguments live in registers, allocas are addresses in the frame
+bool isRegisterValue(llvm::Value* value);
+
+// solves the live in sets of the blocks backwards over their successors
+Liveness liveness(Function* function);
+
+// builds an interval for every value, with the same index as in the liveness
+std::vector<Interval> liveIntervals(Function* function, const Liveness& live);
+
+// linear scan by Poletto and Sarkar, when no register is free the interval with the lowest weight is spilled
+void linearScan(std::vector<Interval>& intervals, const RegisterFile& registers);
+
+// iterated register coalescing by George and Appel, values connected by a move that do not interfere are merged
+// as long as the graph stays colorable, so the move disappears. Spilled values are not rewritten because every
+// instruction loads them in temp registers, the intervals are only used for their index and the stack slots.
+void graphColoring(Function* function, const Liveness& live, std::vector<Interval>& intervals,
+                   const RegisterFile& registers);
+
+// gives every spilled value a stack slot, values that are never live at the same time share their slot,
+// returns the amount of slots
+int assignSpillSlots(const std::vector<Interval>& intervals, std::map<llvm::Value*, int>& slots);
+
+} // namespace mips
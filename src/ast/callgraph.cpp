@@ -0,0 +1,142 @@
+#include "callgraph.h"
+#include <algorithm>
+#include <functional>
+
+namespace Ast
+{
+CallGraph::CallGraph(Scope* root) : root(root)
+{
+    std::function<void(Node*, std::set<std::string>&)> collect = [&](Node* node, auto& callees) {
+        if(auto* call = dynamic_cast<FunctionCall*>(node))
+        {
+            callees.emplace(call->identifier);
+        }
+        for(auto* child : node->children())
+        {
+            collect(child, callees);
+        }
+    };
+
+    for(auto* statement : root->statements)
+    {
+        if(auto* definition = dynamic_cast<FunctionDefinition*>(statement))
+        {
+            collect(definition->body, calls[definition->identifier]);
+        }
+        else if(not dynamic_cast<FunctionDeclaration*>(statement))
+        {
+            // calls outside of functions are always executed
+            collect(statement, roots);
+        }
+    }
+
+    if(calls.count("main"))
+    {
+        roots.emplace("main");
+    }
+    else
+    {
+        for(const auto& [function, _] : calls) roots.emplace(function);
+    }
+}
+
+std::set<std::string> CallGraph::reachable() const
+{
+    std::set<std::string> result;
+    std::vector<std::string> worklist(roots.begin(), roots.end());
+
+    while(not worklist.empty())
+    {
+        auto function = std::move(worklist.back());
+        worklist.pop_back();
+
+        if(not result.emplace(function).second) continue;
+
+        const auto iter = calls.find(function);
+        if(iter == calls.end()) continue;
+
+        for(const auto& callee : iter->second)
+        {
+            if(not result.count(callee)) worklist.emplace_back(callee);
+        }
+    }
+    return result;
+}
+
+std::vector<std::vector<std::string>> CallGraph::components() const
+{
+    // Tarjan's algorithm, which finds the components in reverse topological order
+    std::vector<std::vector<std::string>> result;
+    std::map<std::string, size_t>         index;
+    std::map<std::string, size_t>         low;
+    std::vector<std::string>              stack;
+    std::set<std::string>                 onStack;
+
+    std::function<void(const std::string&)> visit = [&](const std::string& function) {
+        const auto current = index.size();
+        index[function] = low[function] = current;
+        stack.emplace_back(function);
+        onStack.emplace(function);
+
+        for(const auto& callee : calls.at(function))
+        {
+            // only declared, like printf
+            if(not calls.count(callee)) continue;
+
+            if(not index.count(callee))
+            {
+                visit(callee);
+                low[function] = std::min(low[function], low[callee]);
+            }
+            else if(onStack.count(callee))
+            {
+                low[function] = std::min(low[function], index[callee]);
+            }
+        }
+
+        if(low[function] == index[function])
+        {
+            auto&       component = result.emplace_back();
+            std::string member;
+            do
+            {
+                member = stack.back();
+                stack.pop_back();
+                onStack.erase(member);
+                component.emplace_back(member);
+            } while(member != function);
+        }
+    };
+
+    for(const auto& [function, _] : calls)
+    {
+        if(not index.count(function)) visit(function);
+    }
+    return result;
+}
+
+size_t CallGraph::prune()
+{
+    const auto alive = reachable();
+    size_t removed = 0;
+
+    const auto pred = [&](Statement* statement) {
+        if(auto* definition = dynamic_cast<FunctionDefinition*>(statement))
+        {
+            const auto dead = not alive.count(definition->identifier);
+            removed += dead;
+            return dead;
+        }
+        if(auto* declaration = dynamic_cast<FunctionDeclaration*>(statement))
+        {
+            return not alive.count(declaration->identifier);
+        }
+        return false;
+    };
+
+    auto& statements = root->statements;
+    statements.erase(std::remove_if(statements.begin(), statements.end(), pred), statements.end());
+    return removed;
+}
+
+} // namespace Ast
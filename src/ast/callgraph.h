@@ -0,0 +1,32 @@
+#pragma once
+
+#include "statements.h"
+#include <map>
+#include <set>
+
+namespace Ast
+{
+
+// The call graph of a translation unit, built on the completed (checked and folded) ast.
+// Only direct calls exist in the language, so every edge is known statically.
+struct CallGraph
+{
+    explicit CallGraph(Scope* root);
+
+    // all functions that can be reached from main,
+    // or from every defined function if there is no main (library mode)
+    [[nodiscard]] std::set<std::string> reachable() const;
+
+    // the strongly connected components of the defined functions, callees come before their callers
+    [[nodiscard]] std::vector<std::vector<std::string>> components() const;
+
+    // removes the definitions and declarations of unreachable functions from the root scope,
+    // returns the amount of removed function definitions
+    size_t prune();
+
+    Scope* root;
+    std::map<std::string, std::set<std::string>> calls;
+    std::set<std::string> roots;
+};
+
+} // namespace Ast
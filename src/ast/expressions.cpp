@@ -6,6 +6,7 @@
 
 #include "expressions.h"
 #include "helper.h"
+#include "interpreter.h"
 #include <IRVisitor/irVisitor.h>
 
 namespace Ast
@@ -134,13 +135,13 @@ bool Variable::check() const
     {
         if(not res->isInitialized)
         {
-            std::cout << UninitializedWarning(identifier, line, column);
+            diagnostics() << UninitializedWarning(identifier, line, column);
             res->isInitialized = true;
         }
     }
     else
     {
-        std::cout << UndeclaredError(identifier, line, column);
+        diagnostics() << UndeclaredError(identifier, line, column);
         return false;
     }
     return true;
@@ -261,12 +262,12 @@ bool PrefixExpr::check() const
     {
         if(not Helper::is_lvalue(operand))
         {
-            std::cout << RValueError("assigning to", line, column);
+            diagnostics() << RValueError("assigning to", line, column);
             return false;
         }
         if(operand->type()->isConst())
         {
-            std::cout << ConstError(operation.string(), operand->name(), line, column);
+            diagnostics() << ConstError(operation.string(), operand->name(), line, column);
             return false;
         }
     }
@@ -284,12 +285,12 @@ bool PrefixExpr::check() const
     {
         if(operation.isIncrDecr())
         {
-            std::cout << RValueError("assigning to", line, column);
+            diagnostics() << RValueError("assigning to", line, column);
             return false;
         }
         if(operation.type == PrefixOperation::Addr)
         {
-            std::cout << SemanticError("lvalue required as unary & operand", line, column);
+            diagnostics() << SemanticError("lvalue required as unary & operand", line, column);
             return false;
         }
     }
@@ -351,13 +352,13 @@ bool PostfixExpr::check() const
 {
     if(not Helper::is_lvalue(operand))
     {
-        std::cout << RValueError("assigning to", line, column);
+        diagnostics() << RValueError("assigning to", line, column);
         return false;
     }
 
     if(operand->type()->isConst())
     {
-        std::cout << ConstError("postfix expr", operand->name(), line, column);
+        diagnostics() << ConstError("postfix expr", operand->name(), line, column);
         return false;
     }
     return true;
@@ -446,7 +447,7 @@ bool Assignment::check() const
 {
     if(not Helper::is_lvalue(lhs))
     {
-        std::cout << RValueError("assigning to", line, column);
+        diagnostics() << RValueError("assigning to", line, column);
         return false;
     }
 
@@ -455,7 +456,7 @@ bool Assignment::check() const
         const auto& entry = table->lookup(res->identifier);
         if(entry == nullptr)
         {
-            std::cout << UndeclaredError(res->identifier, line, column);
+            diagnostics() << UndeclaredError(res->identifier, line, column);
             return false;
         }
         else
@@ -466,7 +467,7 @@ bool Assignment::check() const
 
     if(lhs->type()->isConst())
     {
-        std::cout << ConstError("assigning to", lhs->name(), line, column);
+        diagnostics() << ConstError("assigning to", lhs->name(), line, column);
         return false;
     }
 
@@ -506,6 +507,24 @@ std::vector<Node*> FunctionCall::children() const
 Node* FunctionCall::fold()
 {
     for(auto& child : arguments) Helper::folder(child);
+
+    // calls to pure functions with literal arguments are evaluated at compile time
+    const auto* entry = table->lookup(identifier);
+    if(not entry or not entry->definition) return this;
+
+    std::vector<TypeVariant> values;
+    for(auto* argument : arguments)
+    {
+        auto* literal = dynamic_cast<Literal*>(argument);
+        if(not literal) return this;
+        values.emplace_back(literal->literal);
+    }
+
+    if(const auto result = Interpreter().call(entry->definition, values))
+    {
+        Interpreter::folded++;
+        return new Literal(*result, table, line, column);
+    }
     return this;
 }
 
@@ -515,19 +534,19 @@ bool FunctionCall::check() const
     {
         if(not res->isInitialized)
         {
-            std::cout << SemanticError("function " + identifier + " declared but not yet defined", line, column);
+            diagnostics() << SemanticError("function " + identifier + " declared but not yet defined", line, column);
             return false;
         }
         if(not res->type->isFunctionType())
         {
-            std::cout << SemanticError("calling non function object: " + identifier, line, column);
+            diagnostics() << SemanticError("calling non function object: " + identifier, line, column);
             return false;
         }
 
         const auto& func = res->type->getFunctionType();
         if(not func.variadic and func.parameters.size() != arguments.size())
         {
-            std::cout << WrongArgumentCount(identifier, func.parameters.size(), arguments.size(), line, column);
+            diagnostics() << WrongArgumentCount(identifier, func.parameters.size(), arguments.size(), line, column);
             return false;
         }
 
@@ -540,7 +559,7 @@ bool FunctionCall::check() const
     }
     else
     {
-        std::cout << UndeclaredError(identifier, line, column);
+        diagnostics() << UndeclaredError(identifier, line, column);
         return false;
     }
 }
@@ -597,12 +616,12 @@ bool SubscriptExpr::check() const
 {
     if(not lhs->type()->isPointerLikeType())
     {
-        std::cout << SemanticError("subscript operator not on pointer or array type", line, column);
+        diagnostics() << SemanticError("subscript operator not on pointer or array type", line, column);
         return false;
     }
     if(not rhs->type()->isIntegralType())
     {
-        std::cout << SemanticError("index type is not integral", line, column);
+        diagnostics() << SemanticError("index type is not integral", line, column);
         return false;
     }
     return true;
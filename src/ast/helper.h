@@ -199,18 +199,18 @@ struct Helper
 
             if(not res->type->isFunctionType())
             {
-                std::cout << RedefinitionError(identifier, line, column);
+                diagnostics() << RedefinitionError(identifier, line, column);
                 return false;
             }
             else if((*res->type->getFunctionType().returnType) != (*returnType))
             {
-                std::cout
+                diagnostics()
                 << SemanticError("redefining function with different return type is not allowed", line, column);
                 result = false;
             }
             else if(res->type->getFunctionType().variadic)
             {
-                std::cout << SemanticError(
+                diagnostics() << SemanticError(
                 "defining similar function without variadic elements is not allowed", line, column);
                 result = false;
             }
@@ -218,7 +218,7 @@ struct Helper
             {
                 if(res->type->getFunctionType().parameters.size() != types.size())
                 {
-                    std::cout << SemanticError("overloading functions is not supported", line, column);
+                    diagnostics() << SemanticError("overloading functions is not supported", line, column);
                     result = false;
                 }
 
@@ -226,7 +226,7 @@ struct Helper
                 {
                     if((*res->type->getFunctionType().parameters[i]) != (*types[i]))
                     {
-                        std::cout << SemanticError("overloading functions is not supported", line, column);
+                        diagnostics() << SemanticError("overloading functions is not supported", line, column);
                         result = false;
                     }
                 }
@@ -238,7 +238,7 @@ struct Helper
         {
             if(type->isVoidType())
             {
-                std::cout << SemanticError("parameter type cannot be void", line, column);
+                diagnostics() << SemanticError("parameter type cannot be void", line, column);
                 return false;
             }
             else if(id.empty())
@@ -247,7 +247,7 @@ struct Helper
             }
             else if(not scope->insert(id, type, true))
             {
-                std::cout << RedefinitionError(id, line, column);
+                diagnostics() << RedefinitionError(id, line, column);
                 return false;
             }
         }
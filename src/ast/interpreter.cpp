@@ -0,0 +1,381 @@
+#include "interpreter.h"
+#include "helper.h"
+#include <climits>
+#include <functional>
+#include <mutex>
+#include <set>
+
+namespace Ast
+{
+std::atomic<size_t> Interpreter::folded = 0;
+
+std::optional<TypeVariant> Interpreter::call(const FunctionDefinition* function, const std::vector<TypeVariant>& arguments)
+{
+    if(not function->returnType->isBaseType() or not pure(function)) return std::nullopt;
+
+    try
+    {
+        return invoke(function, arguments);
+    }
+    catch(const Abort&)
+    {
+        return std::nullopt;
+    }
+}
+
+bool Interpreter::pure(const FunctionDefinition* function)
+{
+    // the verdict is kept in the definition, so it goes away with the ast of its file,
+    // the functions of one wave are folded in parallel and may ask about the same callee
+    static std::mutex mutex;
+
+    std::lock_guard lock(mutex);
+    if(function->purity) return *function->purity;
+
+    // functions that are being checked are assumed to be pure, this handles recursion
+    std::set<const FunctionDefinition*> visited;
+
+    std::function<bool(Node*)>                     node;
+    std::function<bool(const FunctionDefinition*)> definition = [&](const FunctionDefinition* def) {
+        visited.emplace(def);
+        const auto scalar = [](const auto& param) { return param.first->isBaseType(); };
+        return std::all_of(def->parameters.begin(), def->parameters.end(), scalar) and node(def->body);
+    };
+
+    node = [&](Node* root) {
+        if(auto* call = dynamic_cast<FunctionCall*>(root))
+        {
+            const auto* entry = call->table->lookup(call->identifier);
+            if(not entry or not entry->definition) return false;
+            if(not visited.count(entry->definition) and not definition(entry->definition)) return false;
+        }
+        else if(auto* variable = dynamic_cast<Variable*>(root))
+        {
+            auto global = variable->table;
+            while(global->getParent()) global = global->getParent();
+
+            // only constant globals can be read
+            const auto* entry = variable->table->lookup(variable->identifier);
+            if(entry == global->lookup(variable->identifier) and not entry->literal) return false;
+        }
+        else if(auto* prefix = dynamic_cast<PrefixExpr*>(root))
+        {
+            if(prefix->operation == PrefixOperation::Deref or prefix->operation == PrefixOperation::Addr) return false;
+        }
+        else if(dynamic_cast<StringLiteral*>(root))
+        {
+            return false;
+        }
+
+        const auto children = root->children();
+        return std::all_of(children.begin(), children.end(), node);
+    };
+
+    function->purity = definition(function);
+    return *function->purity;
+}
+
+TypeVariant Interpreter::invoke(const FunctionDefinition* function, const std::vector<TypeVariant>& arguments)
+{
+    if(++depth > maxDepth or arguments.size() != function->parameters.size()) throw Abort();
+
+    Frame frame;
+    frame.scopes.emplace_back();
+    for(size_t i = 0; i < arguments.size(); i++)
+    {
+        const auto& [type, identifier] = function->parameters[i];
+        if(not identifier.empty()) declare(frame, identifier, type, arguments[i]);
+    }
+
+    execute(function->body, frame);
+    leave(frame);
+    depth--;
+
+    if(function->returnType->isVoidType()) return 0;
+    // falling of the end of a non void function
+    if(not frame.result) throw Abort();
+    return convert(*frame.result, function->returnType);
+}
+
+Interpreter::Flow Interpreter::execute(Statement* statement, Frame& frame)
+{
+    step();
+
+    if(auto* scope = dynamic_cast<Scope*>(statement))
+    {
+        frame.scopes.emplace_back();
+        for(auto* child : scope->statements)
+        {
+            if(const auto flow = execute(child, frame); flow != Flow::Next)
+            {
+                leave(frame);
+                return flow;
+            }
+        }
+        leave(frame);
+    }
+    else if(auto* declaration = dynamic_cast<VariableDeclaration*>(statement))
+    {
+        std::optional<TypeVariant> value;
+        if(declaration->expr) value = evaluate(declaration->expr, frame);
+        declare(frame, declaration->identifier, declaration->type, value);
+    }
+    else if(auto* loop = dynamic_cast<LoopStatement*>(statement))
+    {
+        frame.scopes.emplace_back();
+        for(auto* init : loop->init) execute(init, frame);
+
+        for(bool first = true;; first = false)
+        {
+            const auto skip = first and loop->doWhile;
+            if(not skip and loop->condition and not truthy(evaluate(loop->condition, frame))) break;
+
+            const auto flow = execute(loop->body, frame);
+            if(flow == Flow::Break) break;
+            if(flow == Flow::Return)
+            {
+                leave(frame);
+                return flow;
+            }
+            if(loop->iteration) evaluate(loop->iteration, frame);
+        }
+        leave(frame);
+    }
+    else if(auto* ifStatement = dynamic_cast<IfStatement*>(statement))
+    {
+        if(truthy(evaluate(ifStatement->condition, frame))) return execute(ifStatement->ifBody, frame);
+        else if(ifStatement->elseBody)
+            return execute(ifStatement->elseBody, frame);
+    }
+    else if(auto* control = dynamic_cast<ControlStatement*>(statement))
+    {
+        return control->type == "break" ? Flow::Break : Flow::Continue;
+    }
+    else if(auto* ret = dynamic_cast<ReturnStatement*>(statement))
+    {
+        if(ret->expr) frame.result = evaluate(ret->expr, frame);
+        return Flow::Return;
+    }
+    else if(auto* expr = dynamic_cast<Expr*>(statement))
+    {
+        evaluate(expr, frame);
+    }
+    else
+    {
+        throw Abort();
+    }
+    return Flow::Next;
+}
+
+TypeVariant Interpreter::evaluate(Expr* expr, Frame& frame)
+{
+    step();
+
+    if(auto* literal = dynamic_cast<Literal*>(expr))
+    {
+        return literal->literal;
+    }
+    else if(auto* variable = dynamic_cast<Variable*>(expr))
+    {
+        // constants may already have been folded away by their declaration
+        const auto* entry = variable->table->lookup(variable->identifier);
+        if(entry and entry->literal)
+        {
+            return convert(*entry->literal, entry->type);
+        }
+        return load(locate(expr, frame));
+    }
+    else if(auto* binary = dynamic_cast<BinaryExpr*>(expr))
+    {
+        if(binary->operation == BinaryOperation::And)
+        {
+            return static_cast<int>(truthy(evaluate(binary->lhs, frame)) and truthy(evaluate(binary->rhs, frame)));
+        }
+        else if(binary->operation == BinaryOperation::Or)
+        {
+            return static_cast<int>(truthy(evaluate(binary->lhs, frame)) or truthy(evaluate(binary->rhs, frame)));
+        }
+        const auto lhs = evaluate(binary->lhs, frame);
+        return Interpreter::binary(lhs, evaluate(binary->rhs, frame), binary->operation);
+    }
+    else if(auto* prefix = dynamic_cast<PrefixExpr*>(expr))
+    {
+        if(prefix->operation.isIncrDecr())
+        {
+            const auto reference = locate(prefix->operand, frame);
+            const auto operation = prefix->operation == PrefixOperation::Incr ? BinaryOperation::Add : BinaryOperation::Sub;
+            store(reference, Interpreter::binary(load(reference), 1, operation));
+            return load(reference);
+        }
+        else if(prefix->operation == PrefixOperation::Neg)
+        {
+            return Interpreter::binary(0, evaluate(prefix->operand, frame), BinaryOperation::Sub);
+        }
+        else if(prefix->operation == PrefixOperation::Not)
+        {
+            return static_cast<int>(not truthy(evaluate(prefix->operand, frame)));
+        }
+        else if(prefix->operation == PrefixOperation::Plus)
+        {
+            return evaluate(prefix->operand, frame);
+        }
+    }
+    else if(auto* postfix = dynamic_cast<PostfixExpr*>(expr))
+    {
+        const auto reference = locate(postfix->operand, frame);
+        const auto operation = postfix->operation == PostfixOperation::Incr ? BinaryOperation::Add : BinaryOperation::Sub;
+        const auto old       = load(reference);
+        store(reference, Interpreter::binary(old, 1, operation));
+        return old;
+    }
+    else if(auto* cast = dynamic_cast<CastExpr*>(expr))
+    {
+        return convert(evaluate(cast->operand, frame), cast->cast);
+    }
+    else if(auto* assignment = dynamic_cast<Assignment*>(expr))
+    {
+        const auto reference = locate(assignment->lhs, frame);
+        store(reference, evaluate(assignment->rhs, frame));
+        return load(reference);
+    }
+    else if(auto* call = dynamic_cast<FunctionCall*>(expr))
+    {
+        const auto* entry = call->table->lookup(call->identifier);
+        if(not entry or not entry->definition) throw Abort();
+
+        std::vector<TypeVariant> arguments;
+        for(auto* argument : call->arguments) arguments.emplace_back(evaluate(argument, frame));
+        return invoke(entry->definition, arguments);
+    }
+    else if(dynamic_cast<SubscriptExpr*>(expr))
+    {
+        return load(locate(expr, frame));
+    }
+    throw Abort();
+}
+
+Interpreter::Reference Interpreter::locate(Expr* expr, Frame& frame)
+{
+    if(auto* variable = dynamic_cast<Variable*>(expr))
+    {
+        for(auto iter = frame.scopes.rbegin(); iter != frame.scopes.rend(); iter++)
+        {
+            if(const auto found = iter->find(variable->identifier); found != iter->end())
+            {
+                return { &found->second, 0, found->second.type };
+            }
+        }
+    }
+    else if(auto* subscript = dynamic_cast<SubscriptExpr*>(expr))
+    {
+        const auto base = locate(subscript->lhs, frame);
+        if(not base.type->isArrayType()) throw Abort();
+
+        const auto index = evaluate(subscript->rhs, frame);
+        if(index.index() == variant_index<TypeVariant, float>()) throw Abort();
+
+        const auto [size, element] = base.type->getArrayType();
+        const auto offset          = std::visit([](auto val) { return static_cast<long long>(val); }, index);
+        if(offset < 0 or offset >= static_cast<long long>(size)) throw Abort();
+
+        return { base.block, base.index + offset * cells(element), element };
+    }
+    throw Abort();
+}
+
+void Interpreter::declare(Frame& frame, const std::string& identifier, Type* type, const std::optional<TypeVariant>& value)
+{
+    const auto size = cells(type);
+    if((memory += size) > maxMemory) throw Abort();
+
+    auto& block = frame.scopes.back()[identifier] = Block{ type, std::vector<std::optional<TypeVariant>>(size) };
+    if(value) store({ &block, 0, type }, *value);
+}
+
+void Interpreter::leave(Frame& frame)
+{
+    for(const auto& [_, block] : frame.scopes.back()) memory -= block.cells.size();
+    frame.scopes.pop_back();
+}
+
+void Interpreter::step()
+{
+    if(++steps > maxSteps) throw Abort();
+}
+
+TypeVariant Interpreter::load(const Reference& reference)
+{
+    // arrays decay to pointers, which are not modelled
+    if(reference.type->isArrayType()) throw Abort();
+
+    const auto& cell = reference.block->cells[reference.index];
+    if(not cell) throw Abort();
+    return *cell;
+}
+
+void Interpreter::store(const Reference& reference, const TypeVariant& value)
+{
+    if(reference.type->isArrayType()) throw Abort();
+    reference.block->cells[reference.index] = convert(value, reference.type);
+}
+
+size_t Interpreter::cells(Type* type)
+{
+    if(type->isArrayType())
+    {
+        const auto& [size, element] = type->getArrayType();
+        return size * cells(element);
+    }
+    return 1;
+}
+
+TypeVariant Interpreter::convert(const TypeVariant& value, Type* type)
+{
+    if(type->isFloatType())
+    {
+        return std::visit([](auto val) { return static_cast<float>(val); }, value);
+    }
+
+    // converting a float that does not fit is undefined
+    if(const auto* val = std::get_if<float>(&value); val and not(*val > INT_MIN - 1.0f and *val < INT_MAX + 1.0f))
+    {
+        throw Abort();
+    }
+
+    if(type->isCharacterType())
+        return std::visit([](auto val) { return static_cast<char>(val); }, value);
+    else if(type->isIntegerType())
+        return std::visit([](auto val) { return static_cast<int>(val); }, value);
+    else
+        throw Abort();
+}
+
+TypeVariant Interpreter::binary(const TypeVariant& lhs, const TypeVariant& rhs, BinaryOperation operation)
+{
+    const auto lambda = [&](auto val0, auto val1) -> TypeVariant {
+        if constexpr(std::is_integral_v<decltype(val0 + val1)>)
+        {
+            // signed overflow is undefined, so it cannot be folded either
+            int res;
+            if(operation == BinaryOperation::Add and __builtin_add_overflow(val0, val1, &res)) throw Abort();
+            if(operation == BinaryOperation::Sub and __builtin_sub_overflow(val0, val1, &res)) throw Abort();
+            if(operation == BinaryOperation::Mul and __builtin_mul_overflow(val0, val1, &res)) throw Abort();
+            if(operation.isDivisionModulo() and val0 == INT_MIN and val1 == -1) throw Abort();
+        }
+
+        auto* literal = Helper::fold_binary(val0, val1, operation, nullptr, 0, 0);
+        if(not literal) throw Abort();
+
+        const auto result = literal->literal;
+        delete literal;
+        return result;
+    };
+    return std::visit(lambda, lhs, rhs);
+}
+
+bool Interpreter::truthy(const TypeVariant& value)
+{
+    return std::visit([](auto val) { return static_cast<bool>(val); }, value);
+}
+
+} // namespace Ast
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "statements.h"
+#include <atomic>
+#include <map>
+#include <optional>
+
+namespace Ast
+{
+
+// Evaluates calls to pure functions at compile time by walking their ast.
+// Every evaluation is bounded in the amount of steps, the call depth and the amount of memory,
+// anything the interpreter cannot model (pointers, globals, io, undefined behaviour) gives up.
+class Interpreter
+{
+    public:
+    explicit Interpreter(size_t maxSteps = 1000000, size_t maxDepth = 256, size_t maxMemory = 65536)
+    : maxSteps(maxSteps), maxDepth(maxDepth), maxMemory(maxMemory)
+    {
+    }
+
+    // returns the result of the call, or nothing if it could not be evaluated
+    std::optional<TypeVariant> call(const FunctionDefinition* function, const std::vector<TypeVariant>& arguments);
+
+    // a function is pure if it only uses its parameters, local variables and constants
+    // and only calls other pure functions
+    static bool pure(const FunctionDefinition* function);
+
+    // the amount of calls that were replaced by a literal
+    static std::atomic<size_t> folded;
+
+    private:
+    struct Abort
+    {
+    };
+
+    enum class Flow
+    {
+        Next,
+        Break,
+        Continue,
+        Return
+    };
+
+    // a variable, arrays are stored flattened, uninitialized cells are empty
+    struct Block
+    {
+        Type*                                   type;
+        std::vector<std::optional<TypeVariant>> cells;
+    };
+
+    struct Reference
+    {
+        Block* block;
+        size_t index;
+        Type*  type;
+    };
+
+    struct Frame
+    {
+        std::vector<std::map<std::string, Block>> scopes;
+        std::optional<TypeVariant>                result;
+    };
+
+    TypeVariant invoke(const FunctionDefinition* function, const std::vector<TypeVariant>& arguments);
+
+    Flow execute(Statement* statement, Frame& frame);
+
+    TypeVariant evaluate(Expr* expr, Frame& frame);
+
+    Reference locate(Expr* expr, Frame& frame);
+
+    void declare(Frame& frame, const std::string& identifier, Type* type, const std::optional<TypeVariant>& value);
+
+    void leave(Frame& frame);
+
+    void step();
+
+    static TypeVariant load(const Reference& reference);
+
+    static void store(const Reference& reference, const TypeVariant& value);
+
+    static size_t cells(Type* type);
+
+    static TypeVariant convert(const TypeVariant& value, Type* type);
+
+    static TypeVariant binary(const TypeVariant& lhs, const TypeVariant& rhs, BinaryOperation operation);
+
+    static bool truthy(const TypeVariant& value);
+
+    size_t maxSteps;
+    size_t maxDepth;
+    size_t maxMemory;
+
+    size_t steps  = 0;
+    size_t depth  = 0;
+    size_t memory = 0;
+};
+
+} // namespace Ast
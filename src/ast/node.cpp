@@ -5,7 +5,12 @@
 //============================================================================
 
 #include "node.h"
+#include "callgraph.h"
 #include "helper.h"
+#include <functional>
+#include <map>
+#include <sstream>
+#include <thread>
 
 namespace Ast
 {
@@ -29,29 +34,165 @@ std::ofstream& operator<< (std::ofstream& stream, const std::unique_ptr<Node>& r
     return stream;
 }
 
-void Node::complete ()
+namespace
 {
-    bool check_result = true;
-    bool fill_result = true;
-
-    std::function<void (Ast::Node*)> fill_recursion = [&] (Ast::Node* root) {
-        fill_result &= root->fill();
-      for (const auto child : root->children ())
-      {
-          fill_recursion (child);
-      }
-    };
+bool fill_recursion(Node* root)
+{
+    bool result = root->fill();
+    for(const auto child : root->children())
+    {
+        result &= fill_recursion(child);
+    }
+    return result;
+}
+
+bool check_recursion(Node* root)
+{
+    bool result = root->check();
+    for(const auto child : root->children())
+    {
+        result &= check_recursion(child);
+    }
+    return result;
+}
+
+// runs the tasks on a few threads, each thread gets a contiguous share of the tasks and stops at its first error,
+// the diagnostics of the shares are printed afterwards in the order of the tasks
+void parallel(size_t count, unsigned jobs, const std::function<void(size_t)>& task)
+{
+    const auto                      shares = std::min<size_t>(jobs, count);
+    std::vector<std::stringstream>  buffers(shares);
+    std::vector<std::exception_ptr> errors(shares);
 
-    std::function<void (Ast::Node*)> check_recursion = [&] (Ast::Node* root) {
-      check_result &= root->check ();
-      for (const auto child : root->children ())
-      {
-          check_recursion (child);
-      }
+    const auto worker = [&](size_t share) {
+        const auto previous = diagnosticStream;
+        diagnosticStream    = &buffers[share];
+        try
+        {
+            for(auto i = share * count / shares; i < (share + 1) * count / shares; i++) task(i);
+        }
+        catch(...)
+        {
+            errors[share] = std::current_exception();
+        }
+        diagnosticStream = previous;
     };
 
-    fill_recursion(this);
-    check_recursion(this);
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < shares; i++)
+    {
+        threads.emplace_back(worker, i);
+    }
+    if(shares) worker(0);
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for(size_t i = 0; i < shares; i++)
+    {
+        diagnostics() << buffers[i].str();
+        if(errors[i]) std::rethrow_exception(errors[i]);
+    }
+}
+
+// Everything outside of the function bodies is handled first and in order.
+// The bodies only share the global symbol table, so they can be filled and checked in parallel.
+// Folding evaluates calls to other functions, so a function is only folded after the functions it calls,
+// functions that call each other are folded together.
+bool complete_parallel(Scope* root, unsigned jobs)
+{
+    bool                             result = root->fill();
+    std::vector<FunctionDefinition*> functions;
+    for(auto* statement : root->statements)
+    {
+        if(auto* function = dynamic_cast<FunctionDefinition*>(statement))
+        {
+            result &= function->fill();
+            functions.emplace_back(function);
+        }
+        else
+        {
+            result &= fill_recursion(statement);
+        }
+    }
+
+    result &= root->check();
+    for(auto* statement : root->statements)
+    {
+        if(not dynamic_cast<FunctionDefinition*>(statement)) result &= check_recursion(statement);
+    }
+
+    std::vector<char> results(functions.size());
+    parallel(functions.size(), jobs, [&](size_t i) {
+        const auto filled  = fill_recursion(functions[i]->body);
+        const auto checked = check_recursion(functions[i]);
+        results[i]         = filled and checked;
+    });
+    if(not result or std::count(results.begin(), results.end(), false)) return false;
+
+    // the constants of the globals are used in the function bodies
+    std::vector<char> removed(root->statements.size());
+    for(size_t i = 0; i < root->statements.size(); i++)
+    {
+        if(not dynamic_cast<FunctionDefinition*>(root->statements[i])) removed[i] = Helper::folder(root->statements[i]);
+    }
+
+    std::map<std::string, FunctionDefinition*> definitions;
+    for(auto* function : functions) definitions[function->identifier] = function;
+
+    const CallGraph graph(root);
+    const auto      components = graph.components();
+
+    std::map<std::string, size_t>    levels;
+    std::vector<std::vector<size_t>> waves;
+    for(size_t i = 0; i < components.size(); i++)
+    {
+        size_t level = 0;
+        for(const auto& function : components[i])
+        {
+            for(const auto& callee : graph.calls.at(function))
+            {
+                if(const auto iter = levels.find(callee); iter != levels.end()) level = std::max(level, iter->second + 1);
+            }
+        }
+        for(const auto& function : components[i]) levels[function] = level;
+
+        if(waves.size() <= level) waves.resize(level + 1);
+        waves[level].emplace_back(i);
+    }
+
+    for(const auto& wave : waves)
+    {
+        parallel(wave.size(), jobs, [&](size_t i) {
+            for(const auto& function : components[wave[i]])
+            {
+                [[maybe_unused]] auto _ = definitions.at(function)->fold();
+            }
+        });
+    }
+
+    for(size_t i = root->statements.size(); i-- > 0;)
+    {
+        if(removed[i]) root->statements.erase(root->statements.begin() + i);
+    }
+    return true;
+}
+} // namespace
+
+void Node::complete(unsigned jobs)
+{
+    if(auto* root = dynamic_cast<Scope*>(this); root and jobs > 1)
+    {
+        if(not complete_parallel(root, jobs))
+        {
+            throw CompilationError("could not complete compilation due to above errors");
+        }
+        return;
+    }
+
+    const auto fill_result  = fill_recursion(this);
+    const auto check_result = check_recursion(this);
     if (not check_result or not fill_result)
     {
         throw CompilationError ("could not complete compilation due to above errors");
@@ -26,7 +26,9 @@ struct Node
 
     friend std::ofstream& operator<<(std::ofstream& stream, const std::unique_ptr<Node>& root);
 
-    void complete();
+    // fills the symbol tables, checks and folds the tree,
+    // with more than one job the function bodies of a file are handled in parallel
+    void complete(unsigned jobs = 1);
 
     [[nodiscard]] virtual std::string name() const = 0;
 
@@ -110,25 +110,25 @@ bool VariableDeclaration::fill() const
             const auto& entry = table->lookup(identifier);
             if(entry->isInitialized)
             {
-                std::cout
+                diagnostics()
                 << SemanticError("redefinition of already defined variable in global scope", line, column);
                 return false;
             }
             else
             {
-                entry->isInitialized |= static_cast<bool>(expr);
+                if(expr) entry->isInitialized = true;
             }
 
             if(*entry->type != *type)
             {
-                std::cout
+                diagnostics()
                 << SemanticError("redefinition of variable with different type in global scope", line, column);
                 return false;
             }
         }
         else
         {
-            std::cout << RedefinitionError(identifier, line, column);
+            diagnostics() << RedefinitionError(identifier, line, column);
             return false;
         }
     }
@@ -139,7 +139,7 @@ bool VariableDeclaration::check() const
 {
     if(type->isVoidType())
     {
-        std::cout << SemanticError("type declaration cannot have void type");
+        diagnostics() << SemanticError("type declaration cannot have void type");
         return false;
     }
 
@@ -147,7 +147,7 @@ bool VariableDeclaration::check() const
     {
         if(table->getType() == ScopeType::global and not expr->constant())
         {
-            std::cout << NonConstantGlobal(identifier, line, column);
+            diagnostics() << NonConstantGlobal(identifier, line, column);
             return false;
         }
         return Type::convert(expr->type(), type, false, line, column);
@@ -191,10 +191,11 @@ bool FunctionDefinition::fill() const
         const auto& entry = table->lookup(identifier);
         if(entry->isInitialized)
         {
-            std::cout << SemanticError("function already defined before", line, column);
+            diagnostics() << SemanticError("function already defined before", line, column);
             return false;
         }
         entry->isInitialized = true;
+        entry->definition    = this;
     }
     return res;
 }
@@ -226,7 +227,7 @@ bool FunctionDefinition::check() const
     }
     else if(not found)
     {
-        std::cout << SemanticError("no return statement in nonvoid function", line, column, true);
+        diagnostics() << SemanticError("no return statement in nonvoid function", line, column, true);
     }
     return true;
 }
@@ -375,7 +376,7 @@ bool ControlStatement::check() const
     }
     else
     {
-        std::cout << SemanticError(type + " statement is not in a loop", line, column);
+        diagnostics() << SemanticError(type + " statement is not in a loop", line, column);
         return false;
     }
 }
@@ -410,7 +411,7 @@ bool ReturnStatement::check() const
     }
     else
     {
-        std::cout << SemanticError("return statement is not in a loop", line, column);
+        diagnostics() << SemanticError("return statement is not in a loop", line, column);
         return false;
     }
 }
@@ -452,13 +453,13 @@ bool IncludeStdioStatement::fill() const
 
     if(not table->insert("printf", funcType, false))
     {
-        std::cout << SemanticError(
+        diagnostics() << SemanticError(
         "cannot include stdio.h: printf already declared with a different signature", line, column);
         return false;
     }
     if(not table->insert("scanf", funcType, false))
     {
-        std::cout << SemanticError(
+        diagnostics() << SemanticError(
         "cannot include stdio.h: scanf already declared with a different signature", line, column);
         return false;
     }
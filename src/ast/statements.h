@@ -9,6 +9,8 @@
 #include "expressions.h"
 #include "node.h"
 
+#include <optional>
+
 namespace Ast
 {
 
@@ -81,6 +83,9 @@ struct FunctionDefinition : public Statement
     std::string                                identifier;
     std::vector<std::pair<Type*, std::string>> parameters;
     Scope*                                     body;
+
+    // whether the function is pure, the interpreter fills it in the first time it is asked
+    mutable std::optional<bool> purity;
 };
 
 struct FunctionDeclaration : public Statement
@@ -132,6 +137,7 @@ struct LoopStatement final : public Statement
     Expr*                   iteration; // can be nullptr
     Statement*              body;
     bool                    doWhile;
+    bool                    unroll = true; // false if preceded by #pragma nounroll
 };
 
 struct IfStatement final : public Statement
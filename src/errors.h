@@ -7,8 +7,18 @@
 #pragma once
 
 #include <antlr4-runtime/tree/ParseTree.h>
+#include <iostream>
 #include "type.h"
 
+// errors and warnings of the front end are written here,
+// a thread that analyses a function body redirects them to its own buffer
+inline thread_local std::ostream* diagnosticStream = &std::cout;
+
+inline std::ostream& diagnostics()
+{
+    return *diagnosticStream;
+}
+
 class CompilationError : public std::exception
 {
 public:
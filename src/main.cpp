@@ -6,9 +6,14 @@
 
 #include "cst.h"
 #include "visitor.h"
+#include "ast/interpreter.h"
 #include <boost/program_options.hpp>
+#include <thread>
+#include <chrono>
+#include <cmath>
 #include "IRVisitor/irVisitor.h"
 #include "MIPSVisitor/mipsVisitor.h"
+#include "LLVMTarget/llvmTarget.h"
 
 std::string CompilationError::file;
 
@@ -30,17 +35,38 @@ void make_dot(const Type& elem, const std::filesystem::path& path)
 	system(("("+make_png+" ; "+remove_dot+" ) &").c_str());
 }
 
-void compileFile(const std::filesystem::path& input, std::filesystem::path output, bool printCst, bool printAst,
-		int level)
+struct Options {
+	bool printCst = false;
+	bool printAst = false;
+	int level = 1;
+	int unrollBudget = 0; // 0 = no loop unrolling
+	unsigned jobs = 1;
+	bool emitAsm = true;
+	bool emitLl = false;
+	bool emitBc = false;
+	bool llvmBackend = false;
+	bool time = false;
+	mips::Allocator allocator = mips::Allocator::linear;
+};
+
+void compileFile(const std::filesystem::path& input, std::filesystem::path output, const Options& options)
 {
 	try {
 		const auto llPath = output.replace_extension("ll");
+		const auto bcPath = output.replace_extension("bc");
 		const auto asmPath = output.replace_extension("asm");
 		const auto cstPath = output.replace_extension("cst.png");
 		output.replace_extension("");
 		const auto astPath = output.replace_extension("ast.png");
 		CompilationError::file = input;
 
+		// the time spent in each phase, printed in a note with --time
+		std::vector<std::pair<std::string, std::chrono::steady_clock::time_point>> phases;
+		const auto phase = [&](const std::string& name) {
+			phases.emplace_back(name, std::chrono::steady_clock::now());
+		};
+		phase("start");
+
 		std::ifstream stream(input);
 		if (!stream.good()) throw CompilationError("file could not be read");
 
@@ -70,23 +96,70 @@ void compileFile(const std::filesystem::path& input, std::filesystem::path outpu
 			}
 		}
 
-		if (printCst) make_dot(cst, cstPath);
+		if (options.printCst) make_dot(cst, cstPath);
+		phase("parse");
 
-		const auto ast = Ast::from_cst(cst);
+		Ast::Interpreter::folded = 0;
+		const auto ast = Ast::from_cst(cst, options.jobs);
+		phase("check");
 
-		if (printAst) make_dot(ast, astPath);
+		if (options.printAst) make_dot(ast, astPath);
 
 		IRVisitor visitor(input);
-		visitor.convertAST(ast);
+		visitor.convertAST(ast, options.jobs);
+		phase("convert");
 
-		visitor.LLVMOptimize(level);
+		visitor.LLVMOptimize(options.level, options.unrollBudget, options.jobs);
+		phase("optimise");
 
-		visitor.print(llPath);
+		if (options.emitLl) visitor.print(llPath);
+		if (options.emitBc) visitor.printBitcode(bcPath);
+
+		if (options.emitAsm && options.llvmBackend) {
+			LLVMTarget target(visitor.getModule());
+			target.convertIR();
+			target.print(asmPath);
+		}
+		else if (options.emitAsm) {
+			MIPSVisitor mVisitor(visitor.getModule(), options.allocator);
+			mVisitor.convertIR(visitor.getModule());
+			mVisitor.print(asmPath);
 
-		MIPSVisitor mVisitor(visitor.getModule());
-		mVisitor.convertIR(visitor.getModule());
-		mVisitor.print(asmPath);
+			const auto statistics = mVisitor.getStatistics();
+			if (statistics.values) {
+				std::cout << "\033[1m" << input.string() << ": \033[1;34mnote:\033[0m spilled "
+				          << statistics.values << " value(s) with " << statistics.loads << " load(s) and "
+				          << statistics.stores << " store(s), about " << std::lround(statistics.dynamicLoads)
+				          << " load(s) and " << std::lround(statistics.dynamicStores)
+				          << " store(s) when weighted by loop depth\n";
+			}
+
+			std::string rewrites;
+			for (const auto& [rule, hits]: mVisitor.getPeepholeHits()) {
+				if (hits) rewrites += (rewrites.empty() ? "" : ", ")+rule+" "+std::to_string(hits);
+			}
+			if (not rewrites.empty()) {
+				std::cout << "\033[1m" << input.string() << ": \033[1;34mnote:\033[0m peephole rewrites: " << rewrites
+				          << '\n';
+			}
+		}
+
+		phase("backend");
+
+		if (options.time) {
+			std::cout << "\033[1m" << input.string() << ": \033[1;34mnote:\033[0m milliseconds per phase:";
+			for (size_t i = 1; i<phases.size(); i++) {
+				const auto duration = phases[i].second-phases[i-1].second;
+				std::cout << (i==1 ? " " : ", ") << phases[i].first << " "
+				          << std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+			}
+			std::cout << '\n';
+		}
 
+		if (Ast::Interpreter::folded) {
+			std::cout << "\033[1m" << input.string() << ": \033[1;34mnote:\033[0m evaluated "
+			          << Ast::Interpreter::folded.load() << " function call(s) at compile time\n";
+		}
 		std::cout << "\033[1m" << input.string() << ": \033[1;32mcompilation successful\033[0m\n";
 	}
 	catch (const SyntaxError& ex) {
@@ -114,7 +187,7 @@ std::filesystem::path changeTopFolder(const std::filesystem::path& path, const s
 	return newPath;
 }
 
-void runTests(const std::filesystem::path& path, bool cst, bool ast, int level)
+void runTests(const std::filesystem::path& path, const Options& options)
 {
 	for (const auto& entry: std::filesystem::recursive_directory_iterator(path))    //TODO file
 	{
@@ -123,7 +196,7 @@ void runTests(const std::filesystem::path& path, bool cst, bool ast, int level)
 //		std::cout << entry << '\n';
 		if (newPath.extension()!=".c") continue;
 		std::filesystem::create_directories(newPath.parent_path());
-		compileFile(entry.path(), newPath, cst, ast, level);
+		compileFile(entry.path(), newPath, options);
 	}
 }
 
@@ -138,11 +211,24 @@ int main(int argc, const char** argv)
 			("cst,c", "Print the cst to dot")
 			("ast,a", "Print the ast to dot")
 			("optimisation,O", po::value<int>()->default_value(1),
-					"Run LLVM optimisation passes (0 = none; 1 = constant merge, SROA, mem2reg (default); 2 = all)")
+					"Run LLVM optimisation passes (0 = none; 1 = constant merge, function specialisation, SROA, mem2reg, IPSCCP, dead argument elimination, function attributes, tail call elimination, GVN, loop invariant code motion (default); 2 = all)")
+			("unroll-loops", "Unroll loops with a small constant trip count (only with optimisation level 1)")
+			("unroll-budget", po::value<int>()->default_value(100),
+					"Maximum size of an unrolled loop in instructions")
+			("emit", po::value<std::string>()->default_value("asm"),
+					"Comma separated list of the files to write: asm (MIPS assembly), ll (LLVM IR), bc (LLVM bitcode)")
+			("backend", po::value<std::string>()->default_value("mips"),
+					"Generate the assembly with our own MIPS backend (mips) or with the MIPS target of LLVM (llvm)")
+			("regalloc", po::value<std::string>()->default_value("linear"),
+					"Register allocator of the MIPS backend: linear scan (linear) or graph coloring with copy coalescing (graph)")
+			("time", "Print the time spent in each phase of the compilation")
 			("test,t",
 					"Compile all files in the given folder recursively and place them in the folder 'output'");
+	// no speedup over a single thread has been measured yet, so the option is not listed
 	po::options_description hidden;
 	hidden.add_options()
+			("jobs,j", po::value<unsigned>()->default_value(1),
+					"Check, convert and optimise (only with optimisation level 1) the functions on this many threads (0 = all cores)")
 			("files", po::value<std::vector<std::filesystem::path>>(&files), "files to compile");
 
 	po::options_description combined;
@@ -159,12 +245,45 @@ int main(int argc, const char** argv)
 		std::cout << desc;
 		return 1;
 	}
+	Options options;
+	options.printCst = vm.count("cst");
+	options.printAst = vm.count("ast");
+	options.time = vm.count("time");
+	options.level = vm["optimisation"].as<int>();
+	options.unrollBudget = vm.count("unroll-loops") ? vm["unroll-budget"].as<int>() : 0;
+	options.jobs = vm["jobs"].as<unsigned>();
+	if (options.jobs==0) options.jobs = std::max(1u, std::thread::hardware_concurrency());
+
+	options.llvmBackend = vm["backend"].as<std::string>()=="llvm";
+	if (!options.llvmBackend && vm["backend"].as<std::string>()!="mips") {
+		std::cout << "unknown backend '" << vm["backend"].as<std::string>() << "'\n" << desc;
+		return 1;
+	}
+
+	if (vm["regalloc"].as<std::string>()=="graph") options.allocator = mips::Allocator::graph;
+	else if (vm["regalloc"].as<std::string>()!="linear") {
+		std::cout << "unknown register allocator '" << vm["regalloc"].as<std::string>() << "'\n" << desc;
+		return 1;
+	}
+
+	options.emitAsm = false;
+	std::stringstream emit(vm["emit"].as<std::string>());
+	for (std::string kind; std::getline(emit, kind, ',');) {
+		if (kind=="asm") options.emitAsm = true;
+		else if (kind=="ll") options.emitLl = true;
+		else if (kind=="bc") options.emitBc = true;
+		else {
+			std::cout << "unknown output '" << kind << "'\n" << desc;
+			return 1;
+		}
+	}
+
 	if (vm.count("test")) {
 		if (files.size()!=1 || !std::filesystem::is_directory(files[0])) {
 			std::cout << desc;
 			return 1;
 		}
-		runTests(files[0], vm.count("cst"), vm.count("ast"), vm["optimisation"].as<int>());
+		runTests(files[0], options);
 		return 0;
 	}
 	if (!files.empty()) {
@@ -175,7 +294,7 @@ int main(int argc, const char** argv)
 			}
 
 			for (const auto& file :files) {
-				compileFile(file, file.filename(), vm.count("cst"), vm.count("ast"), vm["optimisation"].as<int>());
+				compileFile(file, file.filename(), options);
 			}
 			return 0;
 		}
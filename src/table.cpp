@@ -47,7 +47,7 @@ void SymbolTable::setUsed(const std::string& id)
 
 bool SymbolTable::insert(const std::string& id, Type* type, bool initialized)
 {
-    return table.emplace(id, TableElement{ type, std::nullopt, initialized, false, false }).second;
+    return table.try_emplace(id, type, initialized).second;
 }
 
 std::shared_ptr<SymbolTable>& SymbolTable::getParent()
@@ -8,11 +8,17 @@
 
 #include "errors.h"
 #include "type.h"
+#include <atomic>
 #include <llvm/IR/Instructions.h>
 #include <memory>
 #include <unordered_map>
 #include <variant>
 
+namespace Ast
+{
+struct FunctionDefinition;
+}
+
 enum class ScopeType
 {
     plain,
@@ -24,12 +30,18 @@ enum class ScopeType
 
 struct TableElement
 {
+    TableElement(Type* type, bool isInitialized) : type(type), isInitialized(isInitialized)
+    {
+    }
+
     Type*                      type;
     std::optional<TypeVariant> literal;
-    bool                       isInitialized;
-    bool                       isDerefed;
-    bool                       isUsed;
+    // the flags of globals are set by the checks of all function bodies, which can run in parallel
+    std::atomic<bool>          isInitialized;
+    std::atomic<bool>          isDerefed = false;
+    std::atomic<bool>          isUsed    = false;
     llvm::Value*               allocaInst{};
+    const Ast::FunctionDefinition* definition = nullptr; // set for defined functions
 };
 
 class SymbolTable
@@ -21,7 +21,9 @@ overloaded(Ts...)->overloaded<Ts...>;
 {
     return std::visit(
     overloaded{ [&](std::monostate empty) { return std::string("void"); },
-                [&](const Type* ptr) { return ptr->string() + "*" + (isTypeConst ? " const" : "") + " " + name; },
+                [&](const Type* ptr) {
+                    return ptr->string() + "*" + (isTypeConst ? " const" : "") + (isTypeRestrict ? " restrict" : "") + " " + name;
+                },
                 [&](BaseType base) { return (isTypeConst ? "const " : "") + toString(base) + " " + name; },
                 [&](const FunctionType& func) {
                     auto res = func.returnType->string();
@@ -91,6 +93,16 @@ bool Type::isConst() const
     return isTypeConst;
 }
 
+bool Type::isRestrict() const
+{
+    return isTypeRestrict;
+}
+
+void Type::setRestrict(bool isRestrict)
+{
+    isTypeRestrict = isRestrict;
+}
+
 bool Type::isBaseType() const
 {
     return type.index() == 2;
@@ -225,7 +237,7 @@ Type* Type::unary(PrefixOperation operation, Type* operand, size_t line, size_t
         }
         else
         {
-            std::cout << SemanticError("cannot dereference non-pointer type " + operand->string(), line, column);
+            diagnostics() << SemanticError("cannot dereference non-pointer type " + operand->string(), line, column);
             return nullptr;
         }
     }
@@ -240,7 +252,7 @@ Type* Type::unary(PrefixOperation operation, Type* operand, size_t line, size_t
     }
     else if((operation == PrefixOperation::Plus or operation == PrefixOperation::Neg) and operand->isPointerType())
     {
-        if(print) std::cout << InvalidOperands(operation.string(), operand->string(), line, column);
+        if(print) diagnostics() << InvalidOperands(operation.string(), operand->string(), line, column);
         return nullptr;
     }
     return operand;
@@ -286,7 +298,7 @@ Type* Type::combine(BinaryOperation operation, Type* lhs, Type* rhs, size_t line
         return rhs;
     }
     if(print)
-        std::cout << InvalidOperands(operation.string(), lhs->string(), rhs->string(), line, column);
+        diagnostics() << InvalidOperands(operation.string(), lhs->string(), rhs->string(), line, column);
     return nullptr;
 }
 
@@ -298,7 +310,7 @@ bool Type::convert(Type* from, Type* to, bool cast, size_t line, size_t column,
     if(to->isArrayType())
     {
         if(print)
-            std::cout << ConversionError(operation, from->string(), to->string(), line, column);
+            diagnostics() << ConversionError(operation, from->string(), to->string(), line, column);
         return false;
     }
 
@@ -306,7 +318,7 @@ bool Type::convert(Type* from, Type* to, bool cast, size_t line, size_t column,
     if((from->isVoidType() and not to->isVoidType()) or (not from->isVoidType() and to->isVoidType()))
     {
         if(print)
-            std::cout << ConversionError(operation, from->string(), to->string(), line, column);
+            diagnostics() << ConversionError(operation, from->string(), to->string(), line, column);
         return false;
     }
 
@@ -316,19 +328,19 @@ bool Type::convert(Type* from, Type* to, bool cast, size_t line, size_t column,
         if(to->isFloatType())
         {
             if(print)
-                std::cout << ConversionError(operation, from->string(), to->string(), line, column);
+                diagnostics() << ConversionError(operation, from->string(), to->string(), line, column);
             return false;
         }
         else if(to->isIntegralType() and not cast)
         {
             if(print)
-                std::cout
+                diagnostics()
                 << PointerConversionWarning(operation, "from", from->string(), to->string(), line, column);
         }
         else if(from->isArrayType() and not to->isPointerType())
         {
             if(print)
-                std::cout << ConversionError(operation, from->string(), to->string(), line, column);
+                diagnostics() << ConversionError(operation, from->string(), to->string(), line, column);
             return false;
         }
     }
@@ -339,13 +351,13 @@ bool Type::convert(Type* from, Type* to, bool cast, size_t line, size_t column,
         if(from->isFloatType())
         {
             if(print)
-                std::cout << ConversionError(operation, from->string(), to->string(), line, column);
+                diagnostics() << ConversionError(operation, from->string(), to->string(), line, column);
             return false;
         }
         else if(from->isIntegralType() and not cast)
         {
             if(print)
-                std::cout
+                diagnostics()
                 << PointerConversionWarning(operation, "to", from->string(), to->string(), line, column);
         }
     }
@@ -353,19 +365,19 @@ bool Type::convert(Type* from, Type* to, bool cast, size_t line, size_t column,
     // casting to narrower type
     if(from->isBaseType() and to->isBaseType() and to->getBaseType() < from->getBaseType() and not cast)
     {
-        std::cout << NarrowingConversion(operation, from->string(), to->string(), line, column);
+        diagnostics() << NarrowingConversion(operation, from->string(), to->string(), line, column);
     }
     // casting to narrower basetype
     if(not cast and from->isPointerType() and to->isPointerType() and (*from) != (*to))
     {
         if(print)
-            std::cout << PointerConversionWarning(operation, "to", from->string(), to->string(), line, column);
+            diagnostics() << PointerConversionWarning(operation, "to", from->string(), to->string(), line, column);
     }
 
     // converting ptr to char is very narrowing
     if(from->isPointerType() and to->isCharacterType())
     {
-        std::cout << NarrowingConversion(operation, from->string(), to->string(), line, column);
+        diagnostics() << NarrowingConversion(operation, from->string(), to->string(), line, column);
     }
 
     return true;
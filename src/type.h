@@ -94,6 +94,10 @@ class Type
 
     [[nodiscard]] bool isConst() const;
 
+    [[nodiscard]] bool isRestrict() const;
+
+    void setRestrict(bool isRestrict);
+
     [[nodiscard]] bool isBaseType() const;
 
     [[nodiscard]] bool isPointerType() const;
@@ -134,6 +138,7 @@ class Type
 
     private:
     bool isTypeConst;
+    bool isTypeRestrict = false; // only for pointers
     // do not change the order of this variant
     std::variant<std::monostate, Type*, BaseType, FunctionType, ArrayType> type;
 };
\ No newline at end of file
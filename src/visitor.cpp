@@ -383,33 +383,60 @@ Type* visitTypeName(antlr4::tree::ParseTree* context)
         throw;
 }
 
+std::pair<bool, bool> visitQualifier(antlr4::tree::ParseTree* context)
+{
+    // returns whether the qualifiers contain const and restrict
+    bool isConst    = false;
+    bool isRestrict = false;
+    for(const auto& child : context->children)
+    {
+        if(child->getText() == "const") isConst = true;
+        else if(child->getText() == "restrict")
+            isRestrict = true;
+    }
+    return { isConst, isRestrict };
+}
+
 Type* visitBasicType(antlr4::tree::ParseTree* context)
 {
-    bool  isConst = context->children.size() != 1;
-    auto* specifier = *std::find_if(context->children.begin(), context->children.end(), [](const auto& context) {
-        return typeid(*context) == typeid(CParser::SpecifierContext);
-    });
+    bool  isConst = false;
+    auto* specifier = context->children[0];
+    for(const auto& child : context->children)
+    {
+        if(typeid(*child) == typeid(CParser::SpecifierContext))
+        {
+            specifier = child;
+        }
+        else if(const auto [qualifierConst, qualifierRestrict] = visitQualifier(child); qualifierRestrict)
+        {
+            const auto [line, column] = getLineAndColumn(context);
+            std::cout << SemanticError("restrict qualifier can only be applied to pointer types", line, column);
+            throw CompilationError("could not create ast because of above reasons");
+        }
+        else
+        {
+            isConst |= qualifierConst;
+        }
+    }
     return new Type(isConst, specifier->getText());
 }
 
 Type* visitPointerType(antlr4::tree::ParseTree* context, Type* type)
 {
-    if(context->children.size() == 1)
+    bool isConst    = false;
+    bool isRestrict = false;
+    if(context->children.size() > 1 and dynamic_cast<CParser::QualifierContext*>(context->children[1]))
     {
-        return new Type(false, type);
+        std::tie(isConst, isRestrict) = visitQualifier(context->children[1]);
     }
-    else if(context->children.size() == 3)
-    {
-        return visitPointerType(context->children[2], new Type(true, type));
-    }
-    else if(dynamic_cast<CParser::QualifierContext*>(context->children[1]))
-    {
-        return new Type(true, type);
-    }
-    else
+
+    auto* pointer = new Type(isConst, type);
+    pointer->setRestrict(isRestrict);
+    if(auto* res = dynamic_cast<CParser::PointerTypeContext*>(context->children.back()))
     {
-        return visitPointerType(context->children[1], new Type(false, type));
+        return visitPointerType(res, pointer);
     }
+    return pointer;
 }
 
 Type* visitDeclarationArray(antlr4::tree::ParseTree* context, Type* type)
@@ -754,6 +781,16 @@ Ast::Statement* visitStatement(antlr4::tree::ParseTree* context, std::shared_ptr
     {
         return visitForStatement(child, table);
     }
+    else if(auto* res = dynamic_cast<antlr4::tree::TerminalNode*>(child); res and res->getSymbol()->getType() == CParser::NOUNROLL)
+    {
+        // the pragma is ignored when it is not followed by a loop
+        auto* statement = visitStatement(context->children[1], table, type);
+        if(auto* loop = dynamic_cast<Ast::LoopStatement*>(statement))
+        {
+            loop->unroll = false;
+        }
+        return statement;
+    }
     else
     {
         throw UnexpectedContextType(context);
@@ -790,9 +827,15 @@ Ast::Scope* visitFile(antlr4::tree::ParseTree* context)
     return new Ast::Scope(statements, global, line, column);
 }
 
-std::unique_ptr<Ast::Node> Ast::from_cst(const std::unique_ptr<Cst::Root>& root)
+std::unique_ptr<Ast::Node> Ast::from_cst(const std::unique_ptr<Cst::Root>& root, unsigned jobs)
 {
     auto res = std::unique_ptr<Ast::Node>(visitFile(root->file));
-    res->complete();
+    res->complete(jobs);
+
+    // functions that can never be called are not worth lowering
+    if(auto* scope = dynamic_cast<Ast::Scope*>(res.get()))
+    {
+        Ast::CallGraph(scope).prune();
+    }
     return res;
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include "ast/expressions.h"
 #include "ast/node.h"
 #include "ast/statements.h"
+#include "ast/callgraph.h"
 
 #include "cst.h"
 #include "errors.h"
@@ -46,6 +47,8 @@ size_t visitSizeExpr(antlr4::tree::ParseTree* context);
 
 Type* visitTypeName(antlr4::tree::ParseTree* context);
 
+std::pair<bool, bool> visitQualifier(antlr4::tree::ParseTree* context);
+
 Type* visitBasicType(antlr4::tree::ParseTree* context);
 
 Type* visitPointerType(antlr4::tree::ParseTree* context, Type* type);
@@ -88,5 +91,5 @@ Ast::Scope* visitFile(antlr4::tree::ParseTree* context);
 
 namespace Ast
 {
-std::unique_ptr<Ast::Node> from_cst(const std::unique_ptr<Cst::Root>& root);
+std::unique_ptr<Ast::Node> from_cst(const std::unique_ptr<Cst::Root>& root, unsigned jobs = 1);
 }
\ No newline at end of file
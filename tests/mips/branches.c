@@ -0,0 +1,51 @@
+#include <stdio.h>
+
+// a compare that only a branch uses is emitted as beq, bne, bltz, blez, bgtz, bgez, or slt and a branch,
+// with the constant on the right and the operands swapped when needed
+// Should print "2089 142 3187 3954 4 2 40"
+int calls = 0;
+
+int classify(int x, int y)
+{
+    int bits = 0;
+    calls++;
+    if(x == y) bits = bits + 1;
+    if(x != 0) bits = bits + 2;
+    if(x < 0) bits = bits + 4;
+    if(x <= 0) bits = bits + 8;
+    if(x > 0) bits = bits + 16;
+    if(x >= 0) bits = bits + 32;
+    if(x > 7) bits = bits + 64;
+    if(x <= -3) bits = bits + 128;
+    if(x >= 100000) bits = bits + 256;
+    if(y < x) bits = bits + 512;
+    if(5 < x) bits = bits + 1024;
+    if(x >= y) bits = bits + 2048;
+    return bits;
+}
+
+int main()
+{
+    int array[4];
+    int* p = &array[1];
+    int* q = &array[3];
+    int count = 0;
+    while(p < q)
+    {
+        p++;
+        count++;
+    }
+
+    int sum = 0;
+    for(int i = 10; i > 0; i--)
+    {
+        sum = sum + i;
+        if(sum >= 40) break;
+    }
+    int zero = classify(0, 0);
+    int negative = classify(-3, 1);
+    int equal = classify(8, 8);
+    int large = classify(100000, 5);
+    printf("%d %d %d %d %d %d %d\n", zero, negative, equal, large, calls, count, sum);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+
+// the first four int and the first two float arguments are passed in registers and the rest on the stack,
+// pick passes its arguments swapped and the loop in main keeps its values over the calls
+// Should print "130 24 184"
+int weigh(int a, float x, int b, float y, int c, int d, int e, float z)
+{
+    return a * 100 + b * 10 + c - d + e + (int)(x * y + z);
+}
+
+int pick(int n, int a, int b)
+{
+    if(n == 0) return a * 10 + b;
+    return pick(n - 1, b, a) + 1;
+}
+
+int main()
+{
+    int total = 0;
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        total = total + pick(i, i, 7);
+    }
+    printf("%d %d %d\n", weigh(1, 1.5, 2, 4.0, 3, 4, 5, 0.5), pick(3, 1, 2), total);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include <stdio.h>
+
+// scale only overwrites a few caller saved registers, so the loops keep their values in the others over the call,
+// depth calls itself and has to assume that every caller saved register is lost
+// Should print "1170 40 16"
+int scale(int x, int factor)
+{
+    return x * factor + 1;
+}
+
+int depth(int n, int acc)
+{
+    if(n == 0) return acc;
+    int result = depth(n - 1, acc + scale(n, 1));
+    return result + n - 1;
+}
+
+int main()
+{
+    int total = 0;
+    int odd = 0;
+    int i;
+    for(i = 0; i < 20; i++)
+    {
+        total = total + scale(i, 6);
+        odd = odd + (i % 2);
+    }
+    printf("%d %d %d\n", total + odd, depth(5, 10), odd + 6);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+
+// conditions branch directly to their targets, only the stored result of && and || is materialised
+int calls = 0;
+
+int check(int value)
+{
+    calls++;
+    return value;
+}
+
+int main()
+{
+    int i;
+    int result;
+    if(check(0) && check(1)) printf("wrong\n");
+    if(!(check(1) || check(1)) || !check(1)) printf("wrong\n");
+
+    for(i = 0; i < 10 && !(i > 5 || i == 3); i++)
+    {
+    }
+
+    result = check(1) && (check(0) || check(2));
+    // Should print "6 3 1"
+    printf("%d %d %d\n", calls, i, result);
+    return 0;
+}
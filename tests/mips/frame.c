@@ -0,0 +1,35 @@
+#include <stdio.h>
+
+// add6 is a leaf and needs no frame, total saves $ra once for both of its calls and ping and pong pass their
+// stack arguments on to each other as sibling calls in the same slots
+// Should print "21 36 248"
+int add6(int a, int b, int c, int d, int e, int f)
+{
+    return a + b + c + d + e + f;
+}
+
+int total(int n)
+{
+    if(n <= 0) return 0;
+    return total(n - 1) + add6(n, n, n, n, n, n);
+}
+
+int pong(int n, int a, int b, int c, int d, int e);
+
+int ping(int n, int a, int b, int c, int d, int e)
+{
+    if(n <= 0) return a + b * 2 + c * 3 + d * 4 + e * 5;
+    return pong(n - 1, e, d, c, b, a + n);
+}
+
+int pong(int n, int a, int b, int c, int d, int e)
+{
+    if(n <= 0) return a * 5 + b * 4 + c * 3 + d * 2 + e;
+    return ping(n - 1, b, c, d, e, a * n);
+}
+
+int main()
+{
+    printf("%d %d %d\n", add6(1, 2, 3, 4, 5, 6), total(3), ping(5, 1, 2, 3, 4, 5));
+    return 0;
+}
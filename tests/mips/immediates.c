@@ -0,0 +1,29 @@
+#include <stdio.h>
+
+// the constants fit in the immediate of addiu, andi, ori, xori and slti, the array elements are addressed at a
+// constant offset from $sp or from the label of the global
+// Should print "12 3 -6 40 1 0 7 10"
+int table[4];
+
+int main()
+{
+    int local[3];
+    local[0] = 0;
+    local[1] = 7;
+    local[2] = 3;
+    table[0] = 5;
+    table[3] = 0;
+
+    int x = 15;
+    int masked = (x & 12) | (local[2] & 1);
+    int flipped = x ^ -5;
+    int small = 0;
+    for(int i = 0; i < 10; i++)
+    {
+        small = small + 4;
+        table[1] = table[1] + 1;
+    }
+    printf("%d %d %d %d %d %d %d %d\n", masked & 12, (x | 2) - 12, flipped - (x - 15) + 6, small, x < 20, local[0],
+           local[1], table[1] + table[3]);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include <stdio.h>
+
+// the global sum is kept in a register during the loop, the float constant and array address are loaded once
+int sum = 0;
+float scale = 0;
+int values[10];
+
+int main()
+{
+    int i;
+    for(i = 0; i < 10; i++)
+    {
+        values[i] = i * i;
+    }
+    for(i = 0; i < 10; i++)
+    {
+        sum = sum + values[i];
+        scale = scale + 0.25;
+    }
+    // Should print "285 2.500000"
+    printf("%d %f\n", sum, scale);
+    return 0;
+}
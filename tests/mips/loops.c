@@ -0,0 +1,33 @@
+#include <stdio.h>
+
+// loops are emitted with the condition at the bottom and a guard in front
+int main()
+{
+    int i = 0;
+    int n = 0;
+    while(i < 10)
+    {
+        i++;
+        if(i % 2 == 0) continue;
+        n = n + i;
+    }
+
+    for(i = 10; i < 5; i++)
+    {
+        n = 0;
+    }
+
+    do
+    {
+        n++;
+    } while(n < 0);
+
+    for(;;)
+    {
+        if(n > 30) break;
+        n = n + 2;
+    }
+    // Should print "32 10"
+    printf("%d %d\n", n, i);
+    return 0;
+}
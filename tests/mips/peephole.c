@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+// the global is loaded through la and lw that become one lw, the loop branches over a jump that is inverted
+// Should print "55 10 3628800"
+int total = 0;
+int count = 0;
+
+int main()
+{
+    int product = 1;
+    for(int i = 1; i <= 10; i++)
+    {
+        total = total + i;
+        count = count + 1;
+        if(i % 3 == 0 || i % 3 != 0) product = product * i;
+    }
+    printf("%d %d %d\n", total, count, product);
+    return 0;
+}
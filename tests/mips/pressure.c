@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+// more values are live in the loop than there are registers, the ones used least are spilled
+// Should print "277084330 -1026"
+int mix(int n)
+{
+    int a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7, h = 8, i = 9, j = 10;
+    int k = 11, l = 12, m = 13, o = 14, p = 15, q = 16, r = 17, s = 18, t = 19, u = 20;
+    int v = 21, w = 22, x = 23, y = 24, z = 25;
+    int it = 0;
+    while(it < n)
+    {
+        a = a + b * 3; b = b ^ c; c = c + d; d = d - e; e = e + f; f = f ^ g; g = g + h; h = h - i;
+        i = i + j; j = j ^ k; k = k + l; l = l - m; m = m + o; o = o ^ p; p = p + q; q = q - r;
+        r = r + s; s = s ^ t; t = t + u; u = u - v; v = v + w; w = w ^ x; x = x + y; y = y - z; z = z + a;
+        it++;
+    }
+    return a + b + c + d + e + f + g + h + i + j + k + l + m + o + p + q + r + s + t + u + v + w + x + y + z;
+}
+
+float fmix(int n)
+{
+    float a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7, h = 8, i = 9, j = 10;
+    float k = 11, l = 12, m = 13, o = 14, p = 15, q = 16, r = 17, s = 18, t = 19, u = 20;
+    float v = 21, w = 22, x = 23, y = 24, z = 25, aa = 26, bb = 27, cc = 28, dd = 29, ee = 30, ff = 31;
+    int it = 0;
+    while(it < n)
+    {
+        a = a + b; b = b - c; c = c + d; d = d - e; e = e + f; f = f - g; g = g + h; h = h - i;
+        i = i + j; j = j - k; k = k + l; l = l - m; m = m + o; o = o - p; p = p + q; q = q - r;
+        r = r + s; s = s - t; t = t + u; u = u - v; v = v + w; w = w - x; x = x + y; y = y - z; z = z + aa;
+        aa = aa - bb; bb = bb + cc; cc = cc - dd; dd = dd + ee; ee = ee - ff; ff = ff + a;
+        it++;
+    }
+    return a + b + c + d + e + f + g + h + i + j + k + l + m + o + p + q + r + s + t + u + v + w + x + y + z + aa + bb + cc + dd + ee + ff;
+}
+
+int main()
+{
+    printf("%d %d\n", mix(100), (int) fmix(3));
+    return 0;
+}
@@ -0,0 +1,21 @@
+#include <stdio.h>
+
+// multiplications, divisions and modulo by constants are strength reduced, also with the constant on the left
+int main()
+{
+    int i;
+    int a[5][3];
+    for(i = -7; i <= 7; i = i + 7)
+    {
+        // Should print "-70 -2 -1 -1 -6 -458752", "0 0 0 0 0 0" and "70 2 1 1 6 458752"
+        printf("%d %d %d %d %d %d\n", i * 10, i / 3, i % 3, i / 4, i % 4 - i / -2, 65536 * i);
+    }
+
+    for(i = 0; i < 15; i++)
+    {
+        a[i / 3][i % 3] = i * 7;
+    }
+    // Should print "56 98"
+    printf("%d %d\n", a[2][2], a[4][2]);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include <stdio.h>
+
+// the loops become phi nodes that read each other, so the copies at the end of the loop need the old values
+// Should print "13 21 2 1 55"
+int main()
+{
+    int a = 1;
+    int b = 2;
+    int i;
+    for(i = 0; i < 5; i++)
+    {
+        int t = a;
+        a = b;
+        b = t + a;
+    }
+    int x = 1;
+    int y = 2;
+    for(i = 0; i < 7; i++)
+    {
+        int t = x;
+        x = y;
+        y = t;
+    }
+    int sum = 0;
+    for(i = 1; i <= 10; i++)
+    {
+        sum = sum + i;
+    }
+    printf("%d %d %d %d %d\n", a, b, x, y, sum);
+    return 0;
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+
+// sum is tail recursive and becomes a loop, even and odd call each other as siblings
+int sum(int n, int acc)
+{
+    if(n == 0) return acc;
+    return sum(n - 1, acc + n);
+}
+
+int odd(int n);
+
+int even(int n)
+{
+    if(n == 0) return 1;
+    return odd(n - 1);
+}
+
+int odd(int n)
+{
+    if(n == 0) return 0;
+    return even(n - 1);
+}
+
+int main()
+{
+    // Should print "5050 1 0"
+    printf("%d %d %d\n", sum(100, 0), even(10), even(7));
+    return 0;
+}
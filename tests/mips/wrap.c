@@ -0,0 +1,15 @@
+#include <stdio.h>
+
+// the base case of walk returns before the frame is set up, the registers are only saved on the recursive path
+// Should print "1 1 17 -46"
+int walk(int n)
+{
+    if(n < 2) return 1;
+    return walk(n - 1) - walk(n - 2) * 2 + n;
+}
+
+int main()
+{
+    printf("%d %d %d %d\n", walk(0), walk(1), walk(10), walk(13) - walk(14));
+    return 0;
+}
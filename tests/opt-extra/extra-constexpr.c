@@ -0,0 +1,37 @@
+#include <stdio.h>
+
+// fac(10) and fib(20) are evaluated at compile time, print is not pure and stays a call
+int fac(int n)
+{
+    if(n <= 1) return 1;
+    return n * fac(n - 1);
+}
+
+int fib(int n)
+{
+    int a = 0;
+    int b = 1;
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        int t = a + b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+int print(int x)
+{
+    printf("%d\n", x);
+    return x;
+}
+
+int main()
+{
+    // Should print "3628800 6765" and "7"
+    printf("%d %d\n", fac(10), fib(20));
+    print(7);
+    // fac(13) overflows and is computed at runtime instead
+    return fac(13) == 0;
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+
+// unused and unreachable are never lowered, scanf is not included in the assembly
+int unreachable(int x)
+{
+    return x * 3;
+}
+
+int unused(int x)
+{
+    return unreachable(x) + 1;
+}
+
+int square(int x)
+{
+    return x * x;
+}
+
+int helper(int x)
+{
+    return square(x) + square(x + 1);
+}
+
+int main()
+{
+    // Should print "13"
+    printf("%d\n", helper(2));
+    return 0;
+}
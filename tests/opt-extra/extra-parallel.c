@@ -0,0 +1,38 @@
+#include <stdio.h>
+
+// compile with -j 4: the bodies are checked and converted in parallel, the output does not change
+// even and odd call each other, so they are folded together after square
+// Should print "1 0 49 10"
+int count = 3;
+
+int square(int x)
+{
+    return x * x;
+}
+
+int odd(int n);
+
+int even(int n)
+{
+    if(n == 0) return 1;
+    return odd(n - 1);
+}
+
+int odd(int n)
+{
+    if(n == 0) return 0;
+    return even(n - 1);
+}
+
+int next()
+{
+    count = count + 1;
+    int count = 10;
+    return count;
+}
+
+int main()
+{
+    printf("%d %d %d %d", even(4), odd(4), square(7), next());
+    return 0;
+}
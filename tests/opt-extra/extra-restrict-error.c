@@ -0,0 +1,6 @@
+// restrict can only be applied to pointer types
+int main()
+{
+    int restrict a = 5;
+    return a;
+}
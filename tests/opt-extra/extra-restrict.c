@@ -0,0 +1,24 @@
+#include <stdio.h>
+
+// the restrict parameters get noalias, so a[i] is not reloaded after the store to b[i]
+void scale(int* restrict a, int* restrict b, int n)
+{
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        b[i] = a[i] * 2;
+        b[i] = b[i] + a[i];
+    }
+}
+
+int main()
+{
+    int x[4];
+    int y[4];
+    int i;
+    for(i = 0; i < 4; i++) x[i] = i;
+    scale(x, y, 4);
+    // Should print "9"
+    printf("%d\n", y[3]);
+    return 0;
+}
